@@ -0,0 +1,144 @@
+/*
+    Headless throughput benchmark for the terminal's output path.
+    Feeds each corpus file through TerminalModel::processOutput in the same chunk
+    size the PTY reader delivers, without SDL, a window or a shell.
+
+    usage: tiny_term_bench [--columns N] [--rows N] [--megabytes N] [corpus files...]
+    With no files the bundled corpus in bench/corpus is used.
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../include/terminal_model.h"
+
+//every heap allocation in the process goes through here so the parse loop can be checked for allocations
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size){
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept{
+    std::free(memory);
+}
+
+struct BenchResult{
+    double megabytesPerSecond;
+    double nanosecondsPerByte;
+    double allocationsPerMegabyte;
+    double sequencesPerSecond;
+};
+
+static bool readFile(const std::string& path, std::string& contents){
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+        return false;
+
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    contents = stream.str();
+    return true;
+}
+
+static BenchResult runCorpus(const std::string& corpus, int columns, int rows, size_t targetBytes){
+    const size_t CHUNK_SIZE = 64 * 1024;
+
+    size_t escapesPerPass = 0;
+    for(char character : corpus)
+        if(character == '\e')
+            escapesPerPass++;
+
+    TerminalModel model;
+    model.setScrollbackLines(1024);
+    model.resize(columns, rows);
+
+    //one untimed pass so first touch page faults and lazy setup don't count
+    model.processOutput(corpus.data(), corpus.size());
+
+    size_t passes = (targetBytes + corpus.size() - 1) / corpus.size();
+    uint64_t allocationsBefore = allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t pass = 0; pass < passes; pass++){
+        for(size_t offset = 0; offset < corpus.size(); offset += CHUNK_SIZE){
+            size_t length = std::min(CHUNK_SIZE, corpus.size() - offset);
+            model.processOutput(corpus.data() + offset, length);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double bytes = static_cast<double>(passes) * corpus.size();
+    double megabytes = bytes / (1024.0 * 1024.0);
+
+    return {
+        megabytes / seconds,
+        seconds * 1e9 / bytes,
+        allocations / megabytes,
+        passes * escapesPerPass / seconds
+    };
+}
+
+int main(int argc, char* argv[]){
+    int columns = 200;
+    int rows = 60;
+    size_t targetBytes = 256 * 1024 * 1024;
+    std::vector<std::string> corpusPaths;
+
+    for(int i = 1; i < argc; i++){
+        std::string argument = argv[i];
+        if(argument == "--columns" && i + 1 < argc){
+            columns = std::atoi(argv[++i]);
+        }else if(argument == "--rows" && i + 1 < argc){
+            rows = std::atoi(argv[++i]);
+        }else if(argument == "--megabytes" && i + 1 < argc){
+            targetBytes = static_cast<size_t>(std::atof(argv[++i]) * 1024 * 1024);
+        }else{
+            corpusPaths.push_back(argument);
+        }
+    }
+
+    if(corpusPaths.empty()){
+        for(const char* name : {"ascii_log.txt", "sgr_color.txt", "tui_cursor.txt", "utf8_text.txt"})
+            corpusPaths.push_back(std::string(BENCH_CORPUS_DIR) + name);
+    }
+
+    std::printf("%dx%d grid, %zu MB per corpus\n", columns, rows, targetBytes / (1024 * 1024));
+    std::printf("%-20s %10s %10s %12s %14s\n", "corpus", "MB/s", "ns/byte", "allocs/MB", "sequences/s");
+
+    for(const std::string& path : corpusPaths){
+        std::string corpus;
+        if(!readFile(path, corpus) || corpus.empty()){
+            std::fprintf(stderr, "Unable to read corpus file: %s\n", path.c_str());
+            return 1;
+        }
+
+        BenchResult result = runCorpus(corpus, columns, rows, targetBytes);
+
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        std::printf("%-20s %10.1f %10.3f %12.2f %14.0f\n",
+                name.c_str(),
+                result.megabytesPerSecond,
+                result.nanosecondsPerByte,
+                result.allocationsPerMegabyte,
+                result.sequencesPerSecond);
+    }
+
+    return 0;
+}
@@ -4,24 +4,73 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
 
-struct BoundingBox{
-    int width;
-    int height;
-    int xOffset;
-    int yOffset;
-};
+#include "glyph_cache.h"
 
+/*
+    A BDF font covering every encoding in the file, not only ascii.
+    The glyph bitmaps stay in the memory mapped GlyphCache and are looked up
+    by a binary search over its sorted codepoints. A glyph is only copied
+    into the atlas texture the first time it is drawn, and when every atlas
+    slot is taken the least recently drawn glyph gives up its slot.
+*/
 class AsciiFont{
     private:
         std::string bdfFilepath;
         SDL_Renderer* renderer;
-        //offset ascii code by -32 to get array index
-        std::array<SDL_Texture*, 95> characters;
+
+        //glyph bitmaps, from the mapped cache or kept from parsing when the cache can't be used
+        GlyphCache cache;
+        std::vector<uint32_t> parsedCodepoints;
+        std::vector<uint8_t> parsedBitmaps;
+        const uint32_t* codepoints;
+        const uint8_t* bitmaps;
+        size_t glyphCount;
+
+        /*
+            Every glyph lives in a single atlas texture so a whole frame of text
+            can be submitted with one SDL_RenderGeometry call.
+        */
+        static constexpr int ATLAS_COLUMNS = 32;
+        static constexpr int ATLAS_ROWS = 16;
+        static constexpr int SLOT_COUNT = ATLAS_COLUMNS * ATLAS_ROWS;
+        static constexpr int NOT_LOADED = -1;
+        static constexpr int MISSING = -2; //the font has no glyph for the codepoint
+        //always opaque white, queueRect() draws solid rectangles with it so they can share a batch with the glyphs
+        static constexpr int SOLID_SLOT = SLOT_COUNT - 1;
+        SDL_Texture* atlas;
+        int atlasWidth, atlasHeight;
+
+        struct Slot{
+            char32_t codepoint;
+            uint64_t lastUsed; //batch the glyph was last drawn in, for LRU eviction
+            bool used;
+        };
+        std::array<Slot, SLOT_COUNT> slots;
+        //codepoint to slot, or MISSING. Latin-1 is indexed directly since it is looked up for nearly every cell
+        std::array<int, 256> latinSlots;
+        std::unordered_map<char32_t, int> otherSlots;
+        uint64_t batchNumber;
+        std::vector<unsigned char> uploadPixels; //one glyph of RGBA, reused for every upload
+
+        //geometry queued by queue() and submitted by flush(), reused every frame
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
 
         BoundingBox fontBoundingBox;
-        
-        SDL_Texture* createCharacterTexture(std::vector<std::string> characterMap, BoundingBox BBX);
+
+        void rasterizeCharacter(const std::vector<std::string>& characterMap, BoundingBox BBX, uint8_t* glyphBitmap);
+        bool parseBdf(std::vector<uint32_t>& codepoints, std::vector<uint8_t>& bitmaps);
+        bool createAtlas();
+        int findGlyph(char32_t codepoint); //index into codepoints and bitmaps, -1 when the font lacks it
+        int getSlot(char32_t codepoint); //loads the glyph into the atlas if needed
+        int& slotEntry(char32_t codepoint);
+        int claimSlot();
+        SDL_FRect slotRect(int slot);
     public:
         AsciiFont();
         ~AsciiFont();
@@ -30,5 +79,12 @@ class AsciiFont{
         bool load(); //returns false if load is unsuccessful
         int getWidth();
         int getHeight();
-        bool render(float x, float y, char character);
+        size_t getGlyphCount(); //glyphs in the font, not the ones loaded into the atlas
+        //draws a single character immediately, costs one draw call
+        bool render(float x, float y, char32_t character, SDL_FColor color = {1.0f, 1.0f, 1.0f, 1.0f});
+        //adds a character to the current batch tinted with color, nothing is drawn until flush()
+        bool queue(float x, float y, char32_t character, SDL_FColor color = {1.0f, 1.0f, 1.0f, 1.0f});
+        //adds a filled rectangle to the current batch, drawn in order with the glyphs
+        void queueRect(const SDL_FRect& rect, SDL_FColor color);
+        bool flush();
 };
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+
+/*
+    Returns the index of the first byte that is not printable ascii (' ' to '~'),
+    or length if the whole range is printable.
+    Uses AVX2 when the CPU supports it, SSE2 on other x86-64 CPUs and a scalar loop elsewhere.
+*/
+size_t findNonPrintable(const char* data, size_t length);
@@ -0,0 +1,9 @@
+#pragma once
+
+/*
+    How many cells a codepoint takes: 0 for combining marks and other zero
+    width characters, 2 for East Asian wide and fullwidth characters, 1 for
+    everything else. Controls are not handled here, callers filter them first.
+    Looked up in a two level table built at compile time from Unicode 14.0 data.
+*/
+int characterWidth(char32_t codepoint);
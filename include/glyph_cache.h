@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct BoundingBox{
+    int width;
+    int height;
+    int xOffset;
+    int yOffset;
+};
+
+/*
+    A BDF font rasterized to 1 bit per pixel and saved under ~/.cache, so
+    later startups map the file instead of parsing the BDF text again.
+    Every glyph is a bitmap the size of the font bounding box, rows padded
+    to whole bytes with the most significant bit on the left.
+    The cache is keyed by the font's path, size and modification time, and
+    any mismatch is treated as a miss.
+
+    File layout, native endian:
+        GlyphCacheHeader
+        font path, pathLength bytes padded to a multiple of 4
+        uint32_t codepoints[glyphCount], ascending
+        bitmaps, glyphCount * height * bytesPerRow bytes
+*/
+struct GlyphCacheHeader{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtimeNS;
+    int32_t width, height, xOffset, yOffset;
+    uint32_t glyphCount;
+    uint32_t bytesPerRow;
+    uint32_t pathLength;
+};
+
+class GlyphCache{
+private:
+    static const uint32_t VERSION = 3; //3 fixes 2 reading CHARSET_ENCODING as a glyph, 2 stores every encoding, 1 only printable ascii
+
+    void* mapping;
+    size_t mappingSize;
+    const GlyphCacheHeader* header;
+    const uint32_t* codepoints;
+    const uint8_t* bitmaps;
+public:
+    GlyphCache();
+    ~GlyphCache();
+    //empty when there is no usable cache directory
+    static std::string pathFor(const std::string& fontPath);
+    static bool write(const std::string& cachePath, const std::string& fontPath, uint64_t sourceSize, int64_t sourceMtimeNS,
+            BoundingBox boundingBox, const std::vector<uint32_t>& codepoints, const std::vector<uint8_t>& bitmaps);
+    //false on a missing, stale or corrupt cache
+    bool open(const std::string& cachePath, const std::string& fontPath, uint64_t sourceSize, int64_t sourceMtimeNS);
+    void close();
+    BoundingBox getBoundingBox();
+    size_t getGlyphCount();
+    const uint32_t* getCodepoints();
+    const uint8_t* getBitmaps();
+};
@@ -0,0 +1,162 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+struct Cell{
+    char32_t codepoint;
+    uint8_t foreground; //palette indexes, only used when attributes says so
+    uint8_t background;
+    uint8_t attributes;
+    uint8_t flags;
+};
+
+//Cell::attributes, set by SGR
+enum CellAttributes : uint8_t {
+    ATTR_BOLD = 0x01,
+    ATTR_UNDERLINE = 0x02,
+    ATTR_INVERSE = 0x04,
+    ATTR_FOREGROUND = 0x08, //foreground is set, otherwise the theme's default foreground is drawn
+    ATTR_BACKGROUND = 0x10 //background is set, otherwise the theme's default background is drawn
+};
+
+//Cell::flags
+enum CellFlags : uint8_t {
+    CELL_WIDE_CONTINUATION = 0x01, //right half of a wide character, the character is in the cell to the left
+    CELL_COMBINING = 0x02 //has zero width marks in the grid's combining table
+};
+
+/*
+    A fixed size, row-major grid of cells covering the visible screen plus a
+    bounded scrollback history.
+    Rows live in a ring: line 0 is the oldest history line and the screen is
+    always the last `rows` lines. Scrolling the screen up only advances the
+    ring, the top screen row becomes history without being copied and the
+    oldest history row is recycled as the new bottom row.
+    Ring positions don't hold cells themselves, they hold the index of a
+    storage row. Scrolling part of the screen (a scroll region, inserted or
+    deleted lines) rotates those indexes and never moves cell data.
+    Storage is allocated once per resize so writing characters and
+    scrolling never touch the heap.
+    Combining marks are rare, so instead of making every cell bigger they
+    live in a side table keyed by storage position. An entry only counts
+    while its cell has CELL_COMBINING set, overwriting the cell clears the
+    flag and leaves the stale entry to be replaced by the next mark there.
+    Clearing a row hands its entries back to a spare list, so once output
+    settles scrolling reuses them instead of allocating.
+
+    Resizing rewraps lines to the new width without touching the whole
+    history. The old ring is frozen as a history segment, which keeps its
+    storage and width, and only the lines that end up on screen are laid
+    out again. Older lines wait in their segment until scrolling back asks
+    for them with ensureHistory(), so the cost of a resize doesn't grow with
+    the scrollback.
+*/
+class Grid{
+private:
+    static const size_t MAX_COMBINING = 4;
+
+    int columns, rows;
+    int scrollbackCapacity;
+    int capacityRows; //rows + scrollbackCapacity
+    int top; //ring position of line 0
+    int historySize;
+    //left uninitialized, a storage row is always written before it's read
+    std::unique_ptr<Cell[]> cells;
+    size_t cellCapacity;
+    //storage row for each ring position
+    std::vector<int> rowMap;
+    std::vector<int> movedRows; //scratch for rotating rowMap, one entry per screen row
+    //one flag per storage row, set when the row's text continues on the next row
+    std::vector<uint8_t> wrapped;
+    //screen rows changed since the last clearDamage(), only these need repainting
+    std::vector<uint8_t> dirty;
+    bool damaged;
+
+    typedef std::unordered_map<size_t, std::u32string> CombiningTable;
+    CombiningTable combining;
+    std::vector<CombiningTable::node_type> spareCombining;
+    //one flag per storage row, set when the row may have entries in combining
+    std::vector<uint8_t> rowHasCombining;
+
+    /*
+        Rows from before a resize, still at the width they were written with.
+        Lines [firstLine, endLine) in the segment's own ring order are still waiting
+        to be laid out, the rest has been pulled into the ring or dropped.
+    */
+    struct HistorySegment{
+        std::unique_ptr<Cell[]> cells;
+        size_t cellCapacity;
+        int columns, capacityRows, top;
+        std::vector<int> rowMap;
+        std::vector<uint8_t> wrapped;
+        std::vector<uint8_t> rowHasCombining;
+        CombiningTable combining;
+        int firstLine, endLine;
+
+        int storageRow(int line) const { return rowMap[(top + line) % capacityRows]; }
+        const Cell* row(int line) const { return &cells[static_cast<size_t>(storageRow(line)) * columns]; }
+        bool isWrapped(int line) const { return wrapped[storageRow(line)]; }
+    };
+    std::vector<HistorySegment> segments; //oldest first, all of it older than the ring
+    //storage of a released segment, kept for the next resize
+    std::unique_ptr<Cell[]> spareCells;
+    size_t spareCapacity;
+
+    //the logical line being rewrapped, gathered from a segment's rows, reused
+    std::vector<Cell> lineCells;
+    std::vector<std::pair<int, const std::u32string*>> lineMarks; //offset in lineCells and its combining marks
+    std::vector<int> lineBreaks; //where each row of the line starts at the current width
+
+    int ringPosition(int line);
+    int storageRow(int line);
+    int screenStorageRow(int row);
+    int& screenRowEntry(int row); //the rowMap entry of a screen row
+    std::u32string& combiningEntry(int storage, int column);
+    void freezeRing();
+    void allocateRing();
+    int segmentLineStart(const HistorySegment& segment, int lastLine);
+    int segmentLineEnd(const HistorySegment& segment, int firstLine);
+    void loadSegmentLine(const HistorySegment& segment, int firstLine, int lastLine, size_t minimumLength = 0);
+    void breakLine();
+    void writeLineRow(size_t rowIndex, int line);
+    void pullHistoryLine();
+    void releaseNewestSegment();
+    void limitSegments();
+    void clearSegments();
+public:
+    Grid();
+    void setScrollbackCapacity(int lines); //takes effect on the next resize()
+    //rewraps to the new size, cursorColumn and cursorRow are moved along with the text they were on
+    void resize(int newColumns, int newRows, int& cursorColumn, int& cursorRow);
+    //rewraps lines from before a resize until there are at least `lines` of history, or none are left
+    void ensureHistory(int lines);
+    int getColumns();
+    int getRows();
+    int getHistorySize();
+    Cell* getRow(int row);
+    //the screen row as seen when scrolled back viewOffset lines into the history
+    const Cell* getViewRow(int row, int viewOffset);
+    Cell& getCell(int column, int row);
+    bool isWrapped(int row);
+    void setWrapped(int row, bool isWrapped);
+    //attaches a zero width mark to a cell, marks past MAX_COMBINING are dropped
+    void addCombining(int column, int row, char32_t mark);
+    //only valid for a cell with CELL_COMBINING set
+    const std::u32string& getViewCombining(int column, int row, int viewOffset);
+    void clearRow(int row);
+    void clear();
+    void scrollUp();
+    //moves rows first to last up (or down) by lines within themselves, the rows uncovered are cleared. Nothing goes into the history
+    void scrollRegionUp(int first, int last, int lines);
+    void scrollRegionDown(int first, int last, int lines);
+    void markDirty(int row);
+    void markAllDirty();
+    bool isDirty(int row);
+    bool hasDamage();
+    void clearDamage();
+    static Cell blankCell();
+    static bool isBlank(const Cell& cell);
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+/*
+    The xterm 256 color palette: 0-15 are the theme's colors, 16-231 a
+    6x6x6 color cube and 232-255 a gray ramp. Only the first 16 change with
+    the theme, so cells can store any color as a single index.
+*/
+//0xRRGGBB for a palette index, theme holds colors 0-15
+uint32_t paletteColor(int index, const int theme[16]);
+//closest color from the cube and the gray ramp, which is what truecolor is stored as
+uint8_t nearestPaletteColor(unsigned int red, unsigned int green, unsigned int blue);
+//xterm's own colors 0-15, for when no theme is configured
+extern const int DEFAULT_THEME[16];
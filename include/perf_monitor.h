@@ -0,0 +1,54 @@
+#pragma once
+#include <SDL3/SDL.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+    Work done between two presented frames. The terminal fills in everything
+    up to drawCalls, the main loop counts skipped frames and times rendering
+    and presenting.
+*/
+struct FrameStats{
+    uint64_t bytesRead; //taken off the PTY by the reader thread
+    uint64_t bytesParsed;
+    uint64_t escapeSequences;
+    uint64_t cellsDrawn;
+    uint64_t drawCalls;
+    uint64_t framesSkipped; //due frames put off because more output was waiting to be parsed
+    Uint64 parseNS;
+    Uint64 renderNS;
+    Uint64 presentNS;
+};
+
+/*
+    Collects FrameStats for every presented frame, writes them to an optional
+    CSV file and keeps averages over the last half second for the on screen HUD.
+*/
+class PerfMonitor{
+private:
+    static const Uint64 HUD_INTERVAL_NS = SDL_NS_PER_SECOND / 2;
+
+    bool visible;
+    std::ofstream csv;
+    uint64_t frameNumber;
+    Uint64 startNS;
+    Uint64 lastFrameNS;
+
+    //sums since the HUD lines were last rebuilt
+    FrameStats totals;
+    uint64_t framesInInterval;
+    Uint64 intervalStartNS;
+
+    std::vector<std::string> lines;
+public:
+    PerfMonitor();
+    bool openCsv(const std::string& path);
+    void toggle();
+    bool isVisible();
+    //returns true when the HUD text changed and the overlay needs a redraw
+    bool endFrame(const FrameStats& stats);
+    const std::vector<std::string>& getLines();
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <SDL3/SDL.h>
+#include <atomic>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "spsc_ring.h"
+#include "session_recorder.h"
+
+/*
+    Reads the PTY master on a background thread into an SpscRing, so a slow
+    frame on the main thread never stalls the shell and a flood of output
+    never stalls input handling.
+    An SDL event is posted when new output arrives and the main thread hasn't
+    been told yet, acknowledge() must be called before draining the ring.
+    When the ring is full the reader stops reading until the consumer frees
+    space, which leaves the rest in the kernel's PTY buffer and blocks the child.
+    The thread also watches for the PTY becoming writable again when the
+    main thread's input writes hit EAGAIN, and posts the same event then.
+*/
+class PtyReader{
+private:
+    int fd;
+    Uint32 eventType;
+    SpscRing* ring;
+    SessionRecorder* recorder;
+    int wakePipe[2];
+    SDL_Thread* thread;
+    std::atomic<bool> running;
+    std::atomic<bool> notified; //an event is posted and not yet acknowledged
+    std::atomic<bool> waitingForSpace; //the reader is parked on a full ring
+    std::atomic<bool> waitingForWritable; //the main thread has input the PTY didn't take
+    std::atomic<bool> exited;
+    std::atomic<uint64_t> bytesRead;
+
+    static int threadFunction(void* data);
+    void readLoop();
+    void notify();
+    void wake();
+public:
+    PtyReader();
+    ~PtyReader();
+    bool start(int fd, SpscRing* ring, Uint32 eventType);
+    void stop();
+    void setRecorder(SessionRecorder* recorder); //every read is also recorded, set before start()
+    void acknowledge();
+    void spaceAvailable(); //called by the consumer after it frees ring space
+    void watchWritable(); //posts an event once the PTY can take more input
+    bool hasExited(); //true once the PTY reported EOF or an error
+    uint64_t getBytesRead(); //total read since start(), safe to call from any thread
+};
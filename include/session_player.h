@@ -0,0 +1,61 @@
+#pragma once
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+    Plays back an asciicast v2 recording made by SessionRecorder.
+    The output events are written to a pipe on a background thread, either
+    with their recorded timing or as fast as the reader takes them, so the
+    rest of the terminal treats the pipe exactly like a PTY.
+    The pipe is closed after the last event, which reads as the shell exiting.
+    Resize events can't go through the pipe, they are kept with the number of
+    output bytes written before them so the reader can apply each one once it
+    has parsed that far.
+*/
+class SessionPlayer{
+public:
+    struct Resize{
+        uint64_t outputOffset; //bytes of output that come before it
+        int columns, rows;
+    };
+private:
+    struct Event{
+        Uint64 timeNS;
+        size_t offset; //into data
+        size_t length;
+    };
+
+    int columns, rows;
+    std::string data; //every output event decoded and stored back to back
+    std::vector<Event> events;
+    std::vector<Resize> resizes;
+
+    int fd;
+    bool fast;
+    SDL_Thread* thread;
+    std::atomic<bool> running;
+
+    static int threadFunction(void* data);
+    void playLoop();
+    bool writeAll(const char* bytes, size_t length);
+    static bool decodeString(const std::string& line, size_t& position, std::string& output);
+public:
+    SessionPlayer();
+    ~SessionPlayer();
+    bool load(const std::string& path);
+    int getColumns();
+    int getRows();
+    const std::vector<Resize>& getResizes(); //in order, empty until load()
+    bool start(int fd, bool fast); //takes ownership of fd, a non blocking pipe write end
+    void stop();
+};
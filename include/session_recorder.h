@@ -0,0 +1,51 @@
+#pragma once
+#include <SDL3/SDL.h>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "utf8_decoder.h"
+
+/*
+    Records PTY output to a file in the asciicast v2 format, one
+    [seconds, "o", "data"] line per read.
+    record() only appends to an in memory buffer, a background thread writes
+    the buffer out once it passes FLUSH_THRESHOLD or every FLUSH_INTERVAL_MS,
+    so a slow disk never stalls the PTY reader.
+*/
+class SessionRecorder{
+private:
+    static const size_t FLUSH_THRESHOLD = 256 * 1024;
+    static const Sint32 FLUSH_INTERVAL_MS = 500;
+
+    int fd;
+    Uint64 startNS;
+    SDL_Thread* thread;
+    SDL_Mutex* mutex;
+    SDL_Condition* condition;
+    bool running; //guarded by mutex
+
+    //filled by record() and swapped with writing by the writer thread
+    std::string pending;
+    std::string writing;
+
+    //the tail of a UTF-8 sequence split across reads, held back so every event is valid UTF-8
+    char carry[4];
+    size_t carryLength;
+
+    static int threadFunction(void* data);
+    void writeLoop();
+    void appendEvent(char type, const char* data, size_t length);
+public:
+    SessionRecorder();
+    ~SessionRecorder();
+    bool start(const std::string& path, int columns, int rows);
+    void stop(); //flushes everything recorded so far
+    bool isRecording();
+    void record(const char* data, size_t length); //PTY output, called from the reader thread
+    void recordResize(int columns, int rows);
+};
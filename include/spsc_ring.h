@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Lock-free byte ring buffer for exactly one producer thread and one consumer thread.
+    Both sides work on contiguous spans of the buffer so data can be read from
+    a file descriptor straight into the ring and parsed straight out of it.
+    head and tail only ever increase, their difference is the number of buffered bytes.
+*/
+class SpscRing{
+private:
+    std::vector<char> buffer;
+    size_t mask;
+    //kept on separate cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<size_t> head; //next byte to write, only the producer stores it
+    alignas(64) std::atomic<size_t> tail; //next byte to read, only the consumer stores it
+public:
+    SpscRing(size_t capacity = 1 << 22); //rounded up to a power of two
+    void setCapacity(size_t capacity); //discards buffered data, only call while neither thread is using the ring
+    size_t getCapacity();
+    size_t size();
+    bool empty();
+    bool full();
+
+    //producer side
+    char* writableSpan(size_t& length);
+    void commitWrite(size_t length);
+
+    //consumer side
+    const char* readableSpan(size_t& length);
+    void commitRead(size_t length);
+};
@@ -1,99 +1,132 @@
 #pragma once
 #include <SDL3/SDL.h>
 #include <string>
+#include <cstring>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <dirent.h>
 #include <fstream>
 #include <unordered_map>
 #include <termios.h>
-#include <sstream>
+#include <algorithm>
+#include <errno.h>
 
-#include "ascii_font.h"
+#include "terminal_model.h"
+#include "terminal_renderer.h"
+#include "pty_reader.h"
+#include "spsc_ring.h"
+#include "session_recorder.h"
+#include "session_player.h"
+#include "perf_monitor.h"
 #include "paths.h"
 
-struct Line{
-    int row;
-    std::string text;
-};
-
+/*
+    Runs a shell (or a recording) and connects it to a TerminalModel, which
+    holds the emulator state, and a TerminalRenderer, which draws it.
+    Also owns the PTY, its reader thread and the configuration.
+*/
 class Terminal{
 private:
-    int pixelWidth, pixelHeight;
     int columns, rows;
     bool initialized;
 
-    std::vector<std::string> scrollBackLines;
-    int maxScrollbackLines;
-
-    std::vector<Line> lines;
-
-    int tabWidth;
-
-    enum PtyOutputState {
-        NORMAL_TEXT,
-        ESCAPE_START,
-        CSI_SEQUENCE,
-        OSC_SEQUENCE,
-        DCS_SEQUENCE
-    };
-    enum PtyOutputState ptyOutputState;
-    void handleAsciiCode(char command);
-    void handleSingleCharacterSequence(char command);
-    /*
-        These "addTo" functions accumulate characters in their string
-        until they determine the sequence is done.
-        They then call the handle function, reset ptyOutputState to NORMAL_TEXT,
-        and clear their string.
-    */
-    std::string currentCSISequence;
-    void addToCSISequence(char character);
-    void handleCSISequence(std::vector<unsigned int> args, char command);
-    // TODO fully impliment these. They currently just ignore the sequence.
-    std::string currentOSCSequence;
-    void addToOSCSequence(char character);
-    void handleOSCSequence();
-    std::string currentDCSSequence;
-    void addToDCSSequence(char character);
-    void handleDCSSequence();
-
-    int cursorColumn, cursorRow;
+    TerminalModel model;
+    TerminalRenderer terminalRenderer;
 
     std::string shell;
 
     std::string mediaPath;
-    AsciiFont font;
     std::string fontPath;
-    unsigned int paddingX, paddingY;
 
     int theme[16];
 
-    SDL_Texture* renderTarget;
-    SDL_Renderer* renderer;
-
     int masterFD, slaveFD;
     pid_t childPID;
+    bool childExited;
+
+    //filled by ptyReader on its own thread, drained by update()
+    SpscRing outputRing;
+    PtyReader ptyReader;
+    static const size_t PARSE_CHUNK_SIZE = 64 * 1024;
+    size_t readBudgetBytes;
+    Uint64 readBudgetNS;
+    uint64_t totalBytesRead;
+    //copy every byte of shell output to our own stdout, off by default since it doubles the syscalls
+    bool mirrorStdout;
+
+    //keys, pastes and replies the PTY hasn't taken yet, written by flushInput() from inputQueueOffset on
+    std::string inputQueue;
+    size_t inputQueueOffset;
+
+    //counters since the last takeFrameStats()
+    FrameStats frameStats;
+    //running totals from the reader, model and renderer at the last takeFrameStats()
+    FrameStats reportedTotals;
+
+    SessionRecorder recorder;
+    std::string recordPath;
+    //when set the output comes from a recording instead of a shell
+    SessionPlayer player;
+    std::string replayPath;
+    bool replayFast;
+    //the next of the player's resizes, applied once totalBytesRead reaches its offset
+    size_t replayResizeIndex;
+    //a replay changed the size, the window has to follow
+    bool sizeChanged;
+
+    int maxFPS;
+    bool vsync;
+    //how late a frame may be while output is still waiting to be parsed, 0 turns coalescing off
+    Uint64 floodLatencyNS;
 
     bool initPTY();
-    bool initFont();
-    void setPixelDimensions();
+    bool initReplay();
+    void applyReplayResizes();
+    bool holdingFrame();
+    void sendReplies();
+    void queueInput(const char* data, size_t length);
     bool loadConfig();
     bool loadParametersFromFile(std::string filepath, std::unordered_map<std::string, std::string> &parameters);
-    bool drawCharacter(int column, int row, char character); //TODO add color
-    void drawLines();
 public:
-    Terminal(SDL_Renderer* renderer);
+    Terminal();
     ~Terminal();
-    bool init(std::string shell = "sh");
-    void update();
+    void setRecordPath(const std::string& path); //record the session as asciicast, call before init()
+    void setReplay(const std::string& path, bool fast); //play a recording instead of starting a shell, call before start()
+    //loads the config and starts the shell, which needs no window, so it can be started first
+    bool start();
+    bool init(SDL_Renderer* renderer); //loads the font and creates the render target, after start()
+    bool startReader(Uint32 eventType); //output is posted as eventType events once the reader runs
+    bool update();
+    bool needsRender();
+    //when a held synchronized update times out, 0 when nothing is held
+    Uint64 getSynchronizedDeadlineNS();
+    void invalidate(); //forces a full repaint, e.g. after the renderer loses its targets
     bool render(int x = 0, int y = 0);
+    //draws text over the window with the terminal font, for the perf HUD. Call after render()
+    bool drawOverlay(const std::vector<std::string>& lines, int x = 0, int y = 0);
+    FrameStats takeFrameStats(); //returns the counters since the last call and resets them
     void setPadding(unsigned int x, unsigned int y);
     bool updateDimensions(int newWidth, int newHeight);
+    bool takeSizeChange(); //true once after a replay resized the terminal, resize the window to getPixelWidth() and getPixelHeight()
+    void scrollView(int lines); //positive scrolls back into the history
+    void scrollViewPages(int pages);
+    void scrollViewToBottom();
     void sendChar(char character);
     void sendSequence(const std::string& sequence);
+    //clipboard text, wrapped in bracketed paste markers when the application turned them on
+    void paste(const std::string& text);
+    //writes as much queued input as the PTY takes without blocking, call once per loop iteration
+    bool flushInput();
     int getPixelWidth();
     int getPixelHeight();
+    bool isRunning(); //false once the shell has exited and the PTY is closed
+    int getMaxFPS(); //0 means uncapped
+    bool getVsync();
+    Uint64 getFloodLatencyNS();
+    uint64_t getBytesRead(); //total PTY bytes consumed, for throughput measurements
 };
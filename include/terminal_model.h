@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "grid.h"
+#include "vt_parser.h"
+#include "char_width.h"
+#include "palette.h"
+
+/*
+    The emulator state: the grid, the cursor and the escape sequence parser.
+    It has no SDL or PTY dependency, bytes go in through processOutput() and
+    a renderer reads the grid, the cursor and the grid's damage flags back out.
+    A renderer clears the damage once it has drawn it.
+*/
+class TerminalModel : private VtParserHandler{
+private:
+    int columns, rows;
+    //how many lines the view is scrolled back into the history, 0 follows the screen
+    int viewOffset;
+
+    /*
+        Both screens are allocated by resize(), switching between them only
+        swaps the pointer. The alternate screen has no scrollback.
+    */
+    Grid primaryGrid, alternateGrid;
+    Grid* grid; //the screen being shown and written to
+    int cursorColumn, cursorRow;
+    //set after writing the last column, the next printable character wraps first
+    bool wrapPending;
+    //scroll region set by DECSTBM, screen rows inclusive. Line feeds at scrollBottom scroll only these rows
+    int scrollTop, scrollBottom;
+    //colors and attributes written with each character, the codepoint is unused
+    Cell pen;
+    //DECSC state, also where 1049 keeps the primary screen's cursor
+    struct SavedCursor{
+        int column, row;
+        Cell pen;
+        bool wrapPending;
+    };
+    SavedCursor savedCursor;
+
+    //DEC private mode 2026, set while the application is drawing a frame that shouldn't be shown half done
+    bool synchronizedOutput;
+    //when a held update was first seen and how long it may be held, on the caller's clock
+    uint64_t synchronizedSinceNS;
+    uint64_t synchronizedTimeoutNS;
+    //DEC private mode 2004, pastes are wrapped in CSI 200 ~ and CSI 201 ~
+    bool bracketedPaste;
+    //answers to queries like DECRQM, waiting to be written back to the application
+    std::string replies;
+
+    int tabWidth;
+
+    VtParser parser;
+    uint64_t escapeSequenceCount;
+
+    void handleAsciiCode(char command);
+    void putRun(const char* characters, size_t length); //printable ascii only
+    void putCodepoint(char32_t codepoint);
+    void addCombining(char32_t mark);
+    void splitWideCharacters(Cell* cells, int first, int end);
+    void moveCursor(int column, int row);
+    void eraseCells(int row, int first, int end);
+    void wrapLine();
+    void lineFeed();
+    void reverseIndex();
+    void saveCursor();
+    void restoreCursor();
+    void switchScreen(bool alternate);
+    bool isFullScreenRegion();
+    void handleSingleCharacterSequence(char command);
+    void handleCSISequence(const CsiParameters& args, char command);
+    void selectGraphicRendition(const CsiParameters& args);
+    int parseExtendedColor(const CsiParameters& args, int index, int& color);
+    void setPrivateMode(unsigned int mode, bool enabled);
+    void reportMode(unsigned int mode, bool isPrivate);
+    // TODO fully impliment these. They currently just ignore the sequence.
+    void handleOSCSequence(const std::string& data);
+    void handleDCSSequence();
+
+    //VtParserHandler, called by parser
+    void print(const char* characters, size_t length) override;
+    void printCodepoints(const char32_t* codepoints, size_t length) override;
+    void execute(char control) override;
+    void escDispatch(const std::string& intermediates, char final) override;
+    void csiDispatch(const CsiParameters& parameters, const std::string& intermediates, char privateMarker, char final) override;
+    void oscDispatch(const std::string& data) override;
+    void dcsHook(const CsiParameters& parameters, const std::string& intermediates, char privateMarker, char final) override; //counted, otherwise ignored
+    void dcsPut(char character) override; //ignored
+    void dcsUnhook() override;
+public:
+    TerminalModel();
+    void setScrollbackLines(int lines); //takes effect on the next resize()
+    void setTabWidth(int width);
+    void setEightBitControls(bool enabled);
+    //rewraps the text to the new width, keeping the cursor on screen
+    void resize(int newColumns, int newRows);
+    void processOutput(const char* buffer, size_t length);
+    void scrollView(int lines); //positive scrolls back into the history
+    void scrollViewToBottom();
+    int getColumns();
+    int getRows();
+    int getViewOffset();
+    int getCursorColumn();
+    int getCursorRow(); //screen row, add getViewOffset() for the row in the view
+    Grid& getGrid(); //the active screen
+    bool isAlternateScreen();
+    bool isBracketedPaste();
+    //true between BSU and ESU (CSI ? 2026 h and l), the renderer should keep showing the last frame
+    bool isSynchronized();
+    void endSynchronizedUpdate(); //for when the application takes too long to end it
+    //the timeout is kept in this range, 0 would never hold a frame and a long one looks like a hang
+    static constexpr int MIN_SYNC_TIMEOUT_MS = 1;
+    static constexpr int MAX_SYNC_TIMEOUT_MS = 1000;
+    void setSynchronizedTimeout(int milliseconds);
+    //true while a synchronized update holds the last frame, an update held past the timeout is ended
+    bool holdingFrame(uint64_t nowNS);
+    uint64_t getSynchronizedDeadlineNS(); //when the held update times out, 0 when nothing is held
+    //bytes the application expects back, the caller writes them to the PTY and clears them
+    const std::string& getReplies();
+    void clearReplies();
+    uint64_t getEscapeSequenceCount(); //total dispatched since construction
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ascii_font.h"
+#include "terminal_model.h"
+#include "palette.h"
+
+/*
+    Draws a TerminalModel with SDL.
+    The grid is painted into a render target that persists between frames,
+    only rows the model marked dirty are repainted and the damage is cleared
+    afterwards. The cursor is drawn over the copy in the window so moving it
+    never dirties a row.
+    Colors come from the 256 color palette built from the theme. Backgrounds,
+    glyphs and underlines all go into the font's batch, so a colored frame
+    costs the same single draw call as a plain one.
+*/
+class TerminalRenderer{
+private:
+    SDL_Renderer* renderer;
+    AsciiFont font;
+    unsigned int paddingX, paddingY;
+    bool batchRendering;
+
+    int pixelWidth, pixelHeight;
+    SDL_Texture* renderTarget;
+    //the target can be bigger than the window, only the top left pixelWidth x pixelHeight is used
+    int targetWidth, targetHeight;
+    //false for a new or reset target, the next frame clears it and repaints every row
+    bool renderTargetCleared;
+    //where the cursor was last drawn, in view coordinates
+    int renderedCursorColumn, renderedCursorRow;
+
+    //the 256 palette colors followed by the default foreground and background
+    static const int DEFAULT_FOREGROUND = 256;
+    static const int DEFAULT_BACKGROUND = 257;
+    SDL_FColor palette[258];
+
+    //totals since construction, for the perf counters
+    uint64_t cellsDrawn;
+    uint64_t drawCalls;
+
+    bool drawCharacter(int column, int row, char32_t character, SDL_FColor color);
+    void fillRect(const SDL_FRect& rect, SDL_FColor color);
+    void drawRow(Grid& grid, int row, int viewOffset);
+    void drawLines(TerminalModel& model);
+    void drawCursor(TerminalModel& model, int x, int y); //at renderedCursorColumn and renderedCursorRow
+public:
+    TerminalRenderer(SDL_Renderer* renderer);
+    ~TerminalRenderer();
+    void setRenderer(SDL_Renderer* renderer); //for a renderer created after this, call before loadFont()
+    bool loadFont(const std::string& path);
+    void setPadding(unsigned int x, unsigned int y);
+    //colors are 0xRRGGBB, theme holds palette colors 0-15
+    void setTheme(const int theme[16], int foreground, int background);
+    void setBatchRendering(bool enabled); //false draws one glyph per draw call, for comparing the two paths
+    int getCellWidth(); //font width plus padding
+    int getCellHeight();
+    //how many whole cells fit, at least one
+    int columnsForWidth(int width);
+    int rowsForHeight(int height);
+    //keeps the render target while the new size fits it without wasting too much, so dragging the window edge rarely allocates
+    bool resize(int newPixelWidth, int newPixelHeight);
+    int getPixelWidth();
+    int getPixelHeight();
+    bool needsRender(TerminalModel& model);
+    void invalidate(); //forces a full repaint, e.g. after the renderer loses its targets
+    //with updateContents false the last frame is shown again, cursor included, even if the model changed since
+    bool render(TerminalModel& model, int x = 0, int y = 0, bool updateContents = true);
+    //draws text with a black background over the window, call after render()
+    bool drawOverlay(const std::vector<std::string>& lines, int x = 0, int y = 0);
+    uint64_t getCellsDrawnCount();
+    uint64_t getDrawCallCount();
+};
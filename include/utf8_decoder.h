@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+/*
+    Incremental UTF-8 decoder, fed one byte at a time so a sequence can be
+    split across reads. Malformed input follows the WHATWG decoding rules:
+    every maximal invalid subsequence becomes one U+FFFD, overlong forms,
+    surrogates and values past U+10FFFF are rejected.
+*/
+class Utf8Decoder{
+public:
+    static const char32_t REPLACEMENT = 0xFFFD;
+
+    enum Result : uint8_t {
+        INCOMPLETE, //more bytes are needed
+        COMPLETE, //codepoint holds the decoded character, or REPLACEMENT for a bad lead byte
+        REJECTED //the pending sequence is invalid, codepoint is REPLACEMENT and the byte must be fed again
+    };
+private:
+    char32_t partial;
+    int remaining; //continuation bytes still expected
+    //range the next continuation byte has to fall in, narrower than 0x80-0xBF right after some lead bytes
+    unsigned char lowerBoundary, upperBoundary;
+public:
+    Utf8Decoder();
+    Result decode(unsigned char byte, char32_t& codepoint);
+    bool isPending();
+    void reset();
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "ascii_scan.h"
+#include "utf8_decoder.h"
+
+/*
+    CSI and DCS parameters, accumulated digit by digit while the sequence is parsed.
+    Values saturate at MAX_VALUE and parameters past MAX_PARAMETERS are dropped,
+    so a hostile sequence can't allocate or overflow anything.
+    A parameter that followed ':' instead of ';' is a sub-parameter of the one before it.
+*/
+struct CsiParameters{
+    static const int MAX_PARAMETERS = 32;
+    static const unsigned int MAX_VALUE = 0xFFFF;
+
+    uint16_t values[MAX_PARAMETERS];
+    uint32_t subParameterMask; //bit i is set when values[i] is a sub-parameter
+    int count;
+
+    int size() const { return count; }
+    //missing and zero parameters both mean "use the default"
+    unsigned int get(int index, unsigned int defaultValue) const {
+        return index < count && values[index] != 0 ? values[index] : defaultValue;
+    }
+    bool isSubParameter(int index) const { return index < count && (subParameterMask >> index) & 1; }
+};
+
+/*
+    Receives everything VtParser recognizes. privateMarker is one of '<' '=' '>' '?' or 0
+    and intermediates holds up to two bytes from ' ' to '/'.
+    Text arrives through print() as runs of printable ascii and through
+    printCodepoints() as decoded characters from U+0080 up.
+*/
+class VtParserHandler{
+public:
+    virtual ~VtParserHandler() = default;
+    virtual void print(const char* characters, size_t length) = 0;
+    virtual void printCodepoints(const char32_t* codepoints, size_t length) = 0;
+    virtual void execute(char control) = 0;
+    virtual void escDispatch(const std::string& intermediates, char final) = 0;
+    virtual void csiDispatch(const CsiParameters& parameters, const std::string& intermediates, char privateMarker, char final) = 0;
+    virtual void oscDispatch(const std::string& data) = 0;
+    virtual void dcsHook(const CsiParameters& parameters, const std::string& intermediates, char privateMarker, char final) = 0;
+    virtual void dcsPut(char character) = 0;
+    virtual void dcsUnhook() = 0;
+};
+
+/*
+    DEC/VT500 compatible escape sequence parser, following the state machine
+    described at https://vt100.net/emu/dec_ansi_parser
+    Transitions for every state and byte are looked up in tables built at
+    compile time, and all state is kept between calls to parse() so sequences
+    can be split across reads.
+    Text in the ground state is decoded as UTF-8, the decoder also keeps its
+    state between calls. 8-bit C1 controls are only recognized after
+    setEightBitControls(true), which turns UTF-8 decoding off since
+    continuation bytes would collide with C1, bytes 0xA0 to 0xFF are then
+    printed as Latin-1.
+*/
+class VtParser{
+public:
+    enum State : uint8_t {
+        GROUND,
+        ESCAPE,
+        ESCAPE_INTERMEDIATE,
+        CSI_ENTRY,
+        CSI_PARAM,
+        CSI_INTERMEDIATE,
+        CSI_IGNORE,
+        DCS_ENTRY,
+        DCS_PARAM,
+        DCS_INTERMEDIATE,
+        DCS_PASSTHROUGH,
+        DCS_IGNORE,
+        OSC_STRING,
+        SOS_PM_APC_STRING,
+        STATE_COUNT
+    };
+
+    enum Action : uint8_t {
+        NONE,
+        IGNORE,
+        PRINT,
+        EXECUTE,
+        CLEAR,
+        COLLECT,
+        PARAM,
+        ESC_DISPATCH,
+        CSI_DISPATCH,
+        HOOK,
+        PUT,
+        UNHOOK,
+        OSC_START,
+        OSC_PUT,
+        OSC_END,
+        ACTION_COUNT
+    };
+private:
+    static const size_t MAX_INTERMEDIATES = 2;
+    static const size_t MAX_OSC_BYTES = 4096;
+    static const size_t DECODE_BUFFER_SIZE = 256;
+
+    VtParserHandler* handler;
+    State state;
+    bool eightBitControls;
+
+    CsiParameters parameters;
+    bool parametersFull; //a separator arrived after MAX_PARAMETERS, later digits are dropped
+    //reused for every sequence, clear() keeps their capacity
+    std::string intermediates;
+    char privateMarker;
+    bool tooManyIntermediates;
+    std::string oscData;
+
+    Utf8Decoder utf8Decoder;
+    char32_t decoded[DECODE_BUFFER_SIZE];
+
+    size_t decodeUtf8(const char* data, size_t start, size_t length);
+    void performAction(Action action, unsigned char byte);
+    void addParameterByte(unsigned char byte);
+    void transition(State nextState, Action action, unsigned char byte);
+    void clear();
+public:
+    VtParser(VtParserHandler* handler);
+    void setEightBitControls(bool enabled);
+    void parse(const char* data, size_t length);
+    State getState();
+};
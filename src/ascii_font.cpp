@@ -2,6 +2,15 @@
 
 AsciiFont::AsciiFont(){
     this->renderer = nullptr;
+    this->codepoints = nullptr;
+    this->bitmaps = nullptr;
+    this->glyphCount = 0;
+    this->atlas = nullptr;
+    this->atlasWidth = 0;
+    this->atlasHeight = 0;
+    this->slots.fill({0, 0, false});
+    this->latinSlots.fill(NOT_LOADED);
+    this->batchNumber = 0;
     this->fontBoundingBox = {0,0,0,0};
 }
 
@@ -20,158 +29,299 @@ static std::vector<int> getNumsFromString(std::string input){
         while(!(input[i] > 47 && input[i] < 58 && i < input.size())){
             i++;
         }
+        //bounding box offsets can be negative
+        bool negative = i > 0 && input[i - 1] == '-';
         std::string currentNum;
         while(input[i] > 47 && input[i] < 58 && i < input.size()) {
             currentNum += input[i];
             i++;
         }
         if (currentNum != "") {
-            output.push_back(std::stoi(currentNum));
+            output.push_back(negative ? -std::stoi(currentNum) : std::stoi(currentNum));
         }
     }
 
     return output;
 }
 
-SDL_Texture* AsciiFont::createCharacterTexture(std::vector<std::string> characterMap, BoundingBox BBX){
-    const int NUM_COLOR_CHANNELS = 4;
+static int hexDigitValue(char digit){
+    if(digit >= '0' && digit <= '9') return digit - '0';
+    if(digit >= 'A' && digit <= 'F') return digit - 'A' + 10;
+    if(digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+    return 0;
+}
 
-    /* because of the way BDF files work, it is simplest to create pixel data first for the character
-    and then figure out how we can align it using bounging box information for both the font and the individual character */
-    std::vector<unsigned char> characterPixelData;
-    std::vector<unsigned char> boundingPixelData(fontBoundingBox.width * fontBoundingBox.height * NUM_COLOR_CHANNELS, 0);
-
-    // create character pixel data
-    for(std::string row : characterMap){
-        int bits = std::stoi(row, nullptr, 16);
-        int shiftBits = 4 * row.size() - 1;
-        for(int column = 0; column < BBX.width; column++){
-            if((bits >> shiftBits) & 1){
-                characterPixelData.push_back(0xFF);
-                characterPixelData.push_back(0xFF);
-                characterPixelData.push_back(0xFF);
-                characterPixelData.push_back(0xFF);
-            }else{
-                characterPixelData.push_back(0x00);
-                characterPixelData.push_back(0x00);
-                characterPixelData.push_back(0x00);
-                characterPixelData.push_back(0x00);
-            }
-            shiftBits--;
-        }
-    }
-    
-    // calculate coodinates of where the character suface starts in relation to the bounding box
-    int startingRow = fontBoundingBox.height - fontBoundingBox.yOffset + BBX.yOffset - BBX.height;
+/*
+    Writes one glyph into a 1 bit per pixel bitmap the size of the font bounding box,
+    the same layout GlyphCache stores.
+*/
+void AsciiFont::rasterizeCharacter(const std::vector<std::string>& characterMap, BoundingBox BBX, uint8_t* glyphBitmap){
+    int bytesPerRow = (fontBoundingBox.width + 7) / 8;
+
+    /* because of the way BDF files work, the character bitmap has to be aligned inside the font bounding box
+    using the bounding box information for both the font and the individual character */
+    int startingRow = fontBoundingBox.height + fontBoundingBox.yOffset - BBX.yOffset - BBX.height;
     int startingColumn = BBX.xOffset;
     if(startingColumn < 0)
         startingColumn = 0;
-    SDL_Rect coordinates = {startingColumn, startingRow};
 
-    // create the two surfaces
-    SDL_Surface* characterSurface;
-    if(!(characterSurface = SDL_CreateSurfaceFrom(BBX.width, BBX.height, SDL_PIXELFORMAT_RGBA32, characterPixelData.data(), BBX.width * NUM_COLOR_CHANNELS))){
-        SDL_Log("Unable to create character surface from pixel data: %s\n", SDL_GetError());
+    for(int characterRow = 0; characterRow < static_cast<int>(characterMap.size()); characterRow++){
+        int row = startingRow + characterRow;
+        if(row < 0 || row >= fontBoundingBox.height)
+            continue;
+
+        //each hex digit holds 4 pixels, leftmost in the high bit
+        const std::string& rowData = characterMap[characterRow];
+        for(int characterColumn = 0; characterColumn < BBX.width && characterColumn / 4 < static_cast<int>(rowData.size()); characterColumn++){
+            int column = startingColumn + characterColumn;
+            bool set = (hexDigitValue(rowData[characterColumn / 4]) >> (3 - characterColumn % 4)) & 1;
+            if(column >= fontBoundingBox.width || !set)
+                continue;
+
+            glyphBitmap[row * bytesPerRow + column / 8] |= 0x80 >> (column % 8);
+        }
+    }
+}
+
+/*
+    Creates an empty atlas with room for SLOT_COUNT glyphs, they are uploaded as they get used.
+    SOLID_SLOT is filled with white right away.
+*/
+bool AsciiFont::createAtlas(){
+    const int NUM_COLOR_CHANNELS = 4;
+
+    atlasWidth = ATLAS_COLUMNS * fontBoundingBox.width;
+    atlasHeight = ATLAS_ROWS * fontBoundingBox.height;
+    uploadPixels.resize(fontBoundingBox.width * fontBoundingBox.height * NUM_COLOR_CHANNELS);
+
+    if(!(atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, atlasWidth, atlasHeight))){
+        SDL_Log("Unable to create font atlas texture: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(atlas, SDL_SCALEMODE_NEAREST);
+
+    std::fill(uploadPixels.begin(), uploadPixels.end(), 0xFF);
+    SDL_FRect solid = slotRect(SOLID_SLOT);
+    SDL_Rect uploadRect = {static_cast<int>(solid.x), static_cast<int>(solid.y), fontBoundingBox.width, fontBoundingBox.height};
+    if(!SDL_UpdateTexture(atlas, &uploadRect, uploadPixels.data(), fontBoundingBox.width * NUM_COLOR_CHANNELS)){
+        SDL_Log("Unable to upload the solid slot to the font atlas: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+int AsciiFont::findGlyph(char32_t codepoint){
+    const uint32_t* end = codepoints + glyphCount;
+    const uint32_t* found = std::lower_bound(codepoints, end, static_cast<uint32_t>(codepoint));
+    if(found == end || *found != codepoint)
+        return -1;
+    return static_cast<int>(found - codepoints);
+}
+
+int& AsciiFont::slotEntry(char32_t codepoint){
+    if(codepoint < latinSlots.size())
+        return latinSlots[codepoint];
+
+    auto inserted = otherSlots.try_emplace(codepoint, NOT_LOADED);
+    return inserted.first->second;
+}
+
+SDL_FRect AsciiFont::slotRect(int slot){
+    return {
+        static_cast<float>((slot % ATLAS_COLUMNS) * fontBoundingBox.width),
+        static_cast<float>((slot / ATLAS_COLUMNS) * fontBoundingBox.height),
+        static_cast<float>(fontBoundingBox.width),
+        static_cast<float>(fontBoundingBox.height)
+    };
+}
+
+/*
+    Returns a free slot, or evicts the least recently drawn glyph.
+    A glyph drawn in the current batch may still be referenced by queued
+    geometry, so if it is the oldest the batch is flushed before its slot is reused.
+*/
+int AsciiFont::claimSlot(){
+    int oldest = 0;
+    for(int slot = 0; slot < SOLID_SLOT; slot++){
+        if(!slots[slot].used)
+            return slot;
+        if(slots[slot].lastUsed < slots[oldest].lastUsed)
+            oldest = slot;
     }
-    SDL_Surface* boundingSurface;
-    if(!(boundingSurface = SDL_CreateSurfaceFrom(fontBoundingBox.width, fontBoundingBox.height, SDL_PIXELFORMAT_RGBA32, boundingPixelData.data(), fontBoundingBox.width * NUM_COLOR_CHANNELS))){
-        SDL_Log("Unable to create character surface from pixel data: %s\n", SDL_GetError());
+
+    if(slots[oldest].lastUsed == batchNumber)
+        flush();
+
+    slotEntry(slots[oldest].codepoint) = NOT_LOADED;
+    slots[oldest].used = false;
+    return oldest;
+}
+
+int AsciiFont::getSlot(char32_t codepoint){
+    int& entry = slotEntry(codepoint);
+    if(entry >= 0){
+        slots[entry].lastUsed = batchNumber;
+        return entry;
     }
+    if(entry == MISSING)
+        return MISSING;
 
-    // blit the character onto the bounding surface
-    if(!SDL_BlitSurface(characterSurface, nullptr, boundingSurface, &coordinates)){
-        SDL_Log("Unable to blit characterSurface onto boundingSurface: %s\n", SDL_GetError());
+    int glyph = findGlyph(codepoint);
+    if(glyph < 0){
+        entry = MISSING;
+        return MISSING;
     }
-    
-    // create the texture from the combined surfaces
-    SDL_Texture* characterTexture;
-    if(!(characterTexture = SDL_CreateTextureFromSurface(renderer, boundingSurface))){
-        SDL_Log("Unable to create character texture from boundingSurface: %s\n", SDL_GetError());
+
+    int slot = claimSlot();
+
+    //expand the 1 bit per pixel bitmap to RGBA and copy it into the slot
+    const int NUM_COLOR_CHANNELS = 4;
+    int bytesPerRow = (fontBoundingBox.width + 7) / 8;
+    const uint8_t* glyphBitmap = bitmaps + static_cast<size_t>(glyph) * fontBoundingBox.height * bytesPerRow;
+    unsigned char* pixel = uploadPixels.data();
+    for(int row = 0; row < fontBoundingBox.height; row++){
+        for(int column = 0; column < fontBoundingBox.width; column++, pixel += NUM_COLOR_CHANNELS){
+            bool set = glyphBitmap[row * bytesPerRow + column / 8] & (0x80 >> (column % 8));
+            std::memset(pixel, set ? 0xFF : 0x00, NUM_COLOR_CHANNELS);
+        }
     }
 
-    // cleanup
-    SDL_DestroySurface(characterSurface);
-    characterSurface = nullptr;
-    SDL_DestroySurface(boundingSurface);
-    boundingSurface = nullptr;
+    SDL_FRect destination = slotRect(slot);
+    SDL_Rect uploadRect = {static_cast<int>(destination.x), static_cast<int>(destination.y), fontBoundingBox.width, fontBoundingBox.height};
+    if(!SDL_UpdateTexture(atlas, &uploadRect, uploadPixels.data(), fontBoundingBox.width * NUM_COLOR_CHANNELS)){
+        SDL_Log("Unable to upload glyph %u to the font atlas: %s\n", static_cast<unsigned int>(codepoint), SDL_GetError());
+        return MISSING;
+    }
 
-    return characterTexture;
+    slots[slot] = {codepoint, batchNumber, true};
+    //claimSlot() may have added to otherSlots, so the reference from the top can't be reused
+    slotEntry(codepoint) = slot;
+    return slot;
 }
 
-bool AsciiFont::load(){
+/*
+    Parses the BDF file into 1 bit per pixel glyphs, sorted by codepoint.
+*/
+bool AsciiFont::parseBdf(std::vector<uint32_t>& codepoints, std::vector<uint8_t>& bitmaps){
     std::ifstream bdfFile(bdfFilepath);
+    if(!bdfFile.is_open()){
+        SDL_Log("Unable to load font file: %s\n", bdfFilepath.c_str());
+        return false;
+    }
 
-    if(bdfFile.is_open()){
-        std::string line;
-        
-        //find width and height
-        bool boundingBoxFound = false;
-        while(!boundingBoxFound && getline(bdfFile, line)){
-            if(std::string::npos != line.find("FONTBOUNDINGBOX")){
-                boundingBoxFound = true;
-                std::vector nums = getNumsFromString(line);
-                if(nums.size() > 3){
-                    fontBoundingBox.width = nums[0];
-                    fontBoundingBox.height = nums[1];
-                    fontBoundingBox.xOffset = nums[2];
-                    fontBoundingBox.yOffset = nums[3];  
-                } else {
-                    SDL_Log("Error in font file: %s\n", bdfFilepath.c_str());
-                    return false;
-                }
+    std::string line;
+
+    //find width and height
+    bool boundingBoxFound = false;
+    while(!boundingBoxFound && getline(bdfFile, line)){
+        if(std::string::npos != line.find("FONTBOUNDINGBOX")){
+            boundingBoxFound = true;
+            std::vector nums = getNumsFromString(line);
+            if(nums.size() > 3 && nums[0] > 0 && nums[1] > 0){
+                fontBoundingBox.width = nums[0];
+                fontBoundingBox.height = nums[1];
+                fontBoundingBox.xOffset = nums[2];
+                fontBoundingBox.yOffset = nums[3];
+            } else {
+                SDL_Log("Error in font file: %s\n", bdfFilepath.c_str());
+                return false;
             }
         }
-        if(!boundingBoxFound){
-            SDL_Log("Error in font file: %s\n", bdfFilepath.c_str());
-            return false;
-        }
+    }
+    if(!boundingBoxFound){
+        SDL_Log("Error in font file: %s\n", bdfFilepath.c_str());
+        return false;
+    }
+
+    size_t glyphBytes = fontBoundingBox.height * ((fontBoundingBox.width + 7) / 8);
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> glyphs;
 
-        //extract characters
+    //extract characters, only keywords at the start of a line inside STARTCHAR ... ENDCHAR count, CHARSET_ENCODING is a font property
+    while(getline(bdfFile, line)){
+        if(line.rfind("STARTCHAR", 0) != 0)
+            continue;
+
+        //unencoded glyphs have ENCODING -1 and can't be looked up anyway
+        int encoding = -1;
+        BoundingBox characterBoundingBox = {0,0,0,0};
         while(getline(bdfFile, line)){
-            if(std::string::npos != line.find("ENCODING")){
-                int asciiIndex = -1;
+            if(line.rfind("ENCODING ", 0) == 0){
                 std::vector<int> lineNumbers = getNumsFromString(line);
-                if(lineNumbers.size() > 0){
-                    asciiIndex = lineNumbers[0];
-
-                    if(asciiIndex >= ' ' && asciiIndex <= '~'){
-                        BoundingBox characterBoundingBox = {0,0,0,0};
-                        while(getline(bdfFile, line)){
-                            if(std::string::npos != line.find("BBX")){
-
-                                std::vector<int> parameters = getNumsFromString(line);
-                                if(parameters.size() >= 4){
-                                    characterBoundingBox = {parameters[0], parameters[1], parameters[2], parameters[3]};     
-                                }
-                            }else if(std::string::npos != line.find("BITMAP")){
-                                std::vector<std::string> characterData;
-                                while(getline(bdfFile, line) && std::string::npos == line.find("ENDCHAR")){
-                                    characterData.push_back(line);
-                                }
-
-                                characters[asciiIndex - 32] = createCharacterTexture(characterData, characterBoundingBox);
-                                break;
-                            }
-                        }
-                    }
+                if(!lineNumbers.empty())
+                    encoding = lineNumbers[0];
+            }else if(line.rfind("BBX ", 0) == 0){
+                std::vector<int> parameters = getNumsFromString(line);
+                if(parameters.size() >= 4){
+                    characterBoundingBox = {parameters[0], parameters[1], parameters[2], parameters[3]};
+                }
+            }else if(line.rfind("BITMAP", 0) == 0){
+                std::vector<std::string> characterData;
+                while(getline(bdfFile, line) && line.rfind("ENDCHAR", 0) != 0){
+                    characterData.push_back(line);
+                }
+
+                if(encoding >= 0 && encoding <= 0x10FFFF){
+                    glyphs.push_back({static_cast<uint32_t>(encoding), std::vector<uint8_t>(glyphBytes, 0)});
+                    rasterizeCharacter(characterData, characterBoundingBox, glyphs.back().second.data());
                 }
+                break;
+            }else if(line.rfind("ENDCHAR", 0) == 0){
+                break;
             }
         }
+    }
+
+    std::sort(glyphs.begin(), glyphs.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+    for(const auto& glyph : glyphs){
+        codepoints.push_back(glyph.first);
+        bitmaps.insert(bitmaps.end(), glyph.second.begin(), glyph.second.end());
+    }
 
-        bdfFile.close();
-    } else {
+    return true;
+}
+
+/*
+    Loads from the glyph cache when it matches the font file, otherwise parses
+    the BDF and writes the cache for next time.
+*/
+bool AsciiFont::load(){
+    struct stat fontStat;
+    if(stat(bdfFilepath.c_str(), &fontStat) == -1){
         SDL_Log("Unable to load font file: %s\n", bdfFilepath.c_str());
         return false;
     }
+    uint64_t fontSize = fontStat.st_size;
+    int64_t fontMtimeNS = fontStat.st_mtim.tv_sec * 1000000000ll + fontStat.st_mtim.tv_nsec;
 
-    return true;
+    std::string cachePath = GlyphCache::pathFor(bdfFilepath);
+
+    if(!cachePath.empty() && cache.open(cachePath, bdfFilepath, fontSize, fontMtimeNS)){
+        fontBoundingBox = cache.getBoundingBox();
+        codepoints = cache.getCodepoints();
+        bitmaps = cache.getBitmaps();
+        glyphCount = cache.getGlyphCount();
+        return createAtlas();
+    }
+
+    if(!parseBdf(parsedCodepoints, parsedBitmaps))
+        return false;
+
+    //a missing cache only costs startup time, so failing to write one isn't an error
+    if(!cachePath.empty() && !GlyphCache::write(cachePath, bdfFilepath, fontSize, fontMtimeNS, fontBoundingBox, parsedCodepoints, parsedBitmaps))
+        SDL_Log("Unable to write glyph cache: %s\n", cachePath.c_str());
+
+    codepoints = parsedCodepoints.data();
+    bitmaps = parsedBitmaps.data();
+    glyphCount = parsedCodepoints.size();
+    return createAtlas();
 }
 
 AsciiFont::~AsciiFont(){
-    for(SDL_Texture* texture : characters){
-        SDL_DestroyTexture(texture);
-        texture = nullptr;
-    }
+    SDL_DestroyTexture(atlas);
+    atlas = nullptr;
 }
 
 int AsciiFont::getWidth(){
@@ -182,21 +332,101 @@ int AsciiFont::getHeight(){
     return fontBoundingBox.height;
 }
 
-bool AsciiFont::render(float x, float y, char character){
-    if(character > 32 && character < 127) {
-        SDL_FRect destination = {x,y, static_cast<float>(fontBoundingBox.width), static_cast<float>(fontBoundingBox.height)};
-       
-        if(characters[character - 32] == nullptr){
-            SDL_Log("Error, Character %c texture is nullptr!\n", character);
-            return false;
-        }
+size_t AsciiFont::getGlyphCount(){
+    return glyphCount;
+}
 
-        if(!SDL_RenderTexture(renderer, characters[character - 32], nullptr, &destination)){
-            SDL_Log("Error rendering character %c: %s\n", character, SDL_GetError());
-            return false;
-        }
-    } else {
+bool AsciiFont::render(float x, float y, char32_t character, SDL_FColor color){
+    if(character <= U' ')
+        return false;
+
+    if(atlas == nullptr){
+        SDL_Log("Error, font atlas texture is nullptr!\n");
         return false;
     }
-    return true; 
+
+    int slot = getSlot(character);
+    if(slot < 0)
+        return false;
+
+    SDL_FRect source = slotRect(slot);
+    SDL_FRect destination = {x,y, static_cast<float>(fontBoundingBox.width), static_cast<float>(fontBoundingBox.height)};
+    SDL_SetTextureColorModFloat(atlas, color.r, color.g, color.b);
+    bool success = SDL_RenderTexture(renderer, atlas, &source, &destination);
+    SDL_SetTextureColorModFloat(atlas, 1.0f, 1.0f, 1.0f);
+    if(!success){
+        SDL_Log("Error rendering character %u: %s\n", static_cast<unsigned int>(character), SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+bool AsciiFont::queue(float x, float y, char32_t character, SDL_FColor color){
+    if(character <= U' ')
+        return false;
+
+    int slot = getSlot(character);
+    if(slot < 0)
+        return false;
+
+    SDL_FRect source = slotRect(slot);
+    float width = static_cast<float>(fontBoundingBox.width);
+    float height = static_cast<float>(fontBoundingBox.height);
+    float left = source.x / atlasWidth;
+    float top = source.y / atlasHeight;
+    float right = (source.x + source.w) / atlasWidth;
+    float bottom = (source.y + source.h) / atlasHeight;
+
+    int firstVertex = static_cast<int>(vertices.size());
+    vertices.push_back({{x, y}, color, {left, top}});
+    vertices.push_back({{x + width, y}, color, {right, top}});
+    vertices.push_back({{x + width, y + height}, color, {right, bottom}});
+    vertices.push_back({{x, y + height}, color, {left, bottom}});
+
+    indices.push_back(firstVertex);
+    indices.push_back(firstVertex + 1);
+    indices.push_back(firstVertex + 2);
+    indices.push_back(firstVertex);
+    indices.push_back(firstVertex + 2);
+    indices.push_back(firstVertex + 3);
+
+    return true;
+}
+
+void AsciiFont::queueRect(const SDL_FRect& rect, SDL_FColor color){
+    //every corner samples the middle of the white slot, so the quad is the vertex color throughout
+    SDL_FRect solid = slotRect(SOLID_SLOT);
+    SDL_FPoint white = {(solid.x + solid.w / 2) / atlasWidth, (solid.y + solid.h / 2) / atlasHeight};
+
+    int firstVertex = static_cast<int>(vertices.size());
+    vertices.push_back({{rect.x, rect.y}, color, white});
+    vertices.push_back({{rect.x + rect.w, rect.y}, color, white});
+    vertices.push_back({{rect.x + rect.w, rect.y + rect.h}, color, white});
+    vertices.push_back({{rect.x, rect.y + rect.h}, color, white});
+
+    indices.push_back(firstVertex);
+    indices.push_back(firstVertex + 1);
+    indices.push_back(firstVertex + 2);
+    indices.push_back(firstVertex);
+    indices.push_back(firstVertex + 2);
+    indices.push_back(firstVertex + 3);
+}
+
+bool AsciiFont::flush(){
+    //glyphs drawn before this point are no longer referenced by queued geometry
+    batchNumber++;
+
+    if(indices.empty())
+        return true;
+
+    bool success = SDL_RenderGeometry(renderer, atlas, vertices.data(), static_cast<int>(vertices.size()), indices.data(), static_cast<int>(indices.size()));
+    if(!success)
+        SDL_Log("Error rendering glyph batch: %s\n", SDL_GetError());
+
+    //clear keeps the capacity so later frames don't reallocate
+    vertices.clear();
+    indices.clear();
+
+    return success;
 }
@@ -0,0 +1,78 @@
+#include "../include/ascii_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ASCII_SCAN_X86
+#endif
+
+static size_t findNonPrintableScalar(const char* data, size_t length, size_t start){
+    for(size_t i = start; i < length; i++){
+        unsigned char byte = data[i];
+        if(byte < ' ' || byte > '~')
+            return i;
+    }
+    return length;
+}
+
+#ifdef ASCII_SCAN_X86
+/*
+    Adding 0x60 moves ' '..'~' to -128..-34 as signed bytes and every other byte,
+    including DEL and anything with the high bit set, to -33 or above.
+    One signed compare then classifies a whole vector.
+*/
+__attribute__((target("sse2")))
+static size_t findNonPrintableSSE2(const char* data, size_t length){
+    const __m128i shift = _mm_set1_epi8(0x60);
+    const __m128i limit = _mm_set1_epi8(-33);
+
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16){
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i printable = _mm_cmplt_epi8(_mm_add_epi8(bytes, shift), limit);
+        unsigned int mask = _mm_movemask_epi8(printable);
+        if(mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return findNonPrintableScalar(data, length, i);
+}
+
+__attribute__((target("avx2")))
+static size_t findNonPrintableAVX2(const char* data, size_t length){
+    const __m256i shift = _mm256_set1_epi8(0x60);
+    const __m256i limit = _mm256_set1_epi8(-33);
+
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32){
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i printable = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(bytes, shift));
+        unsigned int mask = _mm256_movemask_epi8(printable);
+        if(mask != 0xFFFFFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+
+    return i + findNonPrintableSSE2(data + i, length - i);
+}
+#endif
+
+static size_t findNonPrintableFallback(const char* data, size_t length){
+    return findNonPrintableScalar(data, length, 0);
+}
+
+typedef size_t (*ScanFunction)(const char*, size_t);
+
+static ScanFunction selectScanFunction(){
+#ifdef ASCII_SCAN_X86
+    if(__builtin_cpu_supports("avx2"))
+        return findNonPrintableAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return findNonPrintableSSE2;
+#endif
+    return findNonPrintableFallback;
+}
+
+size_t findNonPrintable(const char* data, size_t length){
+    //chosen once, on first use
+    static const ScanFunction scan = selectScanFunction();
+    return scan(data, length);
+}
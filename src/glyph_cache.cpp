@@ -0,0 +1,173 @@
+#include "../include/glyph_cache.h"
+
+static const char MAGIC[4] = {'T', 'T', 'G', 'C'};
+
+//the path is padded so the codepoints that follow it stay 4 byte aligned
+static size_t paddedPathLength(size_t pathLength){
+    return (pathLength + 3) & ~static_cast<size_t>(3);
+}
+
+GlyphCache::GlyphCache()
+    : mapping(nullptr),
+    mappingSize(0),
+    header(nullptr),
+    codepoints(nullptr),
+    bitmaps(nullptr)
+{}
+
+GlyphCache::~GlyphCache(){
+    close();
+}
+
+std::string GlyphCache::pathFor(const std::string& fontPath){
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    std::string directory;
+    if(cacheHome && cacheHome[0] == '/')
+        directory = cacheHome;
+    else if(home && home[0] == '/')
+        directory = std::string(home) + "/.cache";
+    else
+        return "";
+    directory += "/abrams_tiny_term/";
+
+    //FNV-1a of the path names the file, the path stored inside catches collisions
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(unsigned char character : fontPath){
+        hash ^= character;
+        hash *= 0x100000001b3ull;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.glyphs", static_cast<unsigned long long>(hash));
+    return directory + name;
+}
+
+bool GlyphCache::write(const std::string& cachePath, const std::string& fontPath, uint64_t sourceSize, int64_t sourceMtimeNS,
+        BoundingBox boundingBox, const std::vector<uint32_t>& codepoints, const std::vector<uint8_t>& bitmaps){
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+    if(error)
+        return false;
+
+    GlyphCacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceMtimeNS = sourceMtimeNS;
+    header.width = boundingBox.width;
+    header.height = boundingBox.height;
+    header.xOffset = boundingBox.xOffset;
+    header.yOffset = boundingBox.yOffset;
+    header.glyphCount = codepoints.size();
+    header.bytesPerRow = (boundingBox.width + 7) / 8;
+    header.pathLength = fontPath.size();
+
+    std::string contents;
+    contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents.append(fontPath);
+    contents.append(paddedPathLength(fontPath.size()) - fontPath.size(), '\0');
+    contents.append(reinterpret_cast<const char*>(codepoints.data()), codepoints.size() * sizeof(uint32_t));
+    contents.append(reinterpret_cast<const char*>(bitmaps.data()), bitmaps.size());
+
+    //written beside the cache and renamed over it, so a reader never maps a half written file
+    std::string temporaryPath = cachePath + "." + std::to_string(getpid()) + ".tmp";
+    int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd == -1)
+        return false;
+
+    size_t written = 0;
+    while(written < contents.size()){
+        ssize_t result = ::write(fd, contents.data() + written, contents.size() - written);
+        if(result <= 0 && errno != EINTR)
+            break;
+        if(result > 0)
+            written += result;
+    }
+    ::close(fd);
+
+    if(written != contents.size() || rename(temporaryPath.c_str(), cachePath.c_str()) == -1){
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool GlyphCache::open(const std::string& cachePath, const std::string& fontPath, uint64_t sourceSize, int64_t sourceMtimeNS){
+    close();
+
+    int fd = ::open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+        return false;
+
+    struct stat cacheStat;
+    if(fstat(fd, &cacheStat) == -1 || static_cast<size_t>(cacheStat.st_size) < sizeof(GlyphCacheHeader)){
+        ::close(fd);
+        return false;
+    }
+
+    mappingSize = cacheStat.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED){
+        mapping = nullptr;
+        return false;
+    }
+
+    header = static_cast<const GlyphCacheHeader*>(mapping);
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+        && header->version == VERSION
+        && header->sourceSize == sourceSize
+        && header->sourceMtimeNS == sourceMtimeNS
+        && header->width > 0 && header->height > 0
+        && header->bytesPerRow == static_cast<uint32_t>((header->width + 7) / 8)
+        && header->pathLength == fontPath.size();
+
+    //sizes are checked before anything past the header is touched
+    size_t pathOffset = sizeof(GlyphCacheHeader);
+    size_t codepointOffset = pathOffset + (valid ? paddedPathLength(header->pathLength) : 0);
+    size_t bitmapOffset = codepointOffset + (valid ? header->glyphCount * sizeof(uint32_t) : 0);
+    size_t bitmapSize = valid ? static_cast<size_t>(header->glyphCount) * header->height * header->bytesPerRow : 0;
+
+    valid = valid
+        && bitmapOffset + bitmapSize == mappingSize
+        && std::memcmp(static_cast<const char*>(mapping) + pathOffset, fontPath.data(), fontPath.size()) == 0;
+
+    if(!valid){
+        close();
+        return false;
+    }
+
+    codepoints = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mapping) + codepointOffset);
+    bitmaps = static_cast<const uint8_t*>(mapping) + bitmapOffset;
+    return true;
+}
+
+void GlyphCache::close(){
+    if(mapping)
+        munmap(mapping, mappingSize);
+
+    mapping = nullptr;
+    mappingSize = 0;
+    header = nullptr;
+    codepoints = nullptr;
+    bitmaps = nullptr;
+}
+
+BoundingBox GlyphCache::getBoundingBox(){
+    return {header->width, header->height, header->xOffset, header->yOffset};
+}
+
+size_t GlyphCache::getGlyphCount(){
+    return header->glyphCount;
+}
+
+const uint32_t* GlyphCache::getCodepoints(){
+    return codepoints;
+}
+
+const uint8_t* GlyphCache::getBitmaps(){
+    return bitmaps;
+}
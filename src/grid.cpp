@@ -0,0 +1,527 @@
+#include "../include/grid.h"
+#include <algorithm>
+#include <cstring>
+
+Grid::Grid()
+    : columns(0),
+    rows(0),
+    scrollbackCapacity(0),
+    capacityRows(0),
+    top(0),
+    historySize(0),
+    cellCapacity(0),
+    damaged(false),
+    spareCapacity(0)
+{}
+
+Cell Grid::blankCell(){
+    return {U' ', 0, 0, 0, 0};
+}
+
+bool Grid::isBlank(const Cell& cell){
+    //compared as one 8 byte word, this runs over every trailing blank of the history on a resize
+    static const Cell BLANK = blankCell();
+    return std::memcmp(&cell, &BLANK, sizeof(Cell)) == 0;
+}
+
+int Grid::ringPosition(int line){
+    int position = top + line;
+    return position >= capacityRows ? position - capacityRows : position;
+}
+
+int Grid::storageRow(int line){
+    return rowMap[ringPosition(line)];
+}
+
+int& Grid::screenRowEntry(int row){
+    return rowMap[ringPosition(historySize + row)];
+}
+
+int Grid::screenStorageRow(int row){
+    return storageRow(historySize + row);
+}
+
+void Grid::setScrollbackCapacity(int lines){
+    scrollbackCapacity = lines < 0 ? 0 : lines;
+}
+
+/*
+    The old ring becomes the newest history segment and the screen is filled from the
+    line that was at its top. If the lines from there to the cursor's line no longer
+    fit, the screen is moved down until the cursor's line ends on the bottom row and
+    the rows pushed above it become history. Lines below the cursor fill whatever room
+    is left. Everything older stays in its segment until ensureHistory() asks for it.
+*/
+void Grid::resize(int newColumns, int newRows, int& cursorColumn, int& cursorRow){
+    if(newColumns < 1) newColumns = 1;
+    if(newRows < 1) newRows = 1;
+    if(newColumns == columns && newRows == rows)
+        return;
+
+    bool hadRing = columns > 0;
+    int screenLine = historySize;
+    int cursorLine = historySize + cursorRow;
+    int oldColumns = columns;
+    if(hadRing)
+        freezeRing();
+
+    columns = newColumns;
+    rows = newRows;
+    capacityRows = rows + scrollbackCapacity;
+    allocateRing();
+
+    if(!hadRing){
+        for(int row = 0; row < rows; row++)
+            std::fill_n(getRow(row), columns, blankCell());
+        cursorColumn = 0;
+        cursorRow = 0;
+        return;
+    }
+
+    HistorySegment& source = segments.back();
+
+    //blank rows below the cursor aren't worth keeping
+    while(source.endLine - 1 > cursorLine){
+        const Cell* row = source.row(source.endLine - 1);
+        if(source.isWrapped(source.endLine - 1) || !std::all_of(row, row + oldColumns, isBlank))
+            break;
+        source.endLine--;
+    }
+
+    int cursorLineStart = segmentLineStart(source, cursorLine);
+    int cursorLineEnd = segmentLineEnd(source, cursorLineStart);
+    size_t cursorOffset = static_cast<size_t>(cursorLine - cursorLineStart) * oldColumns + cursorColumn;
+    int screenLineStart = segmentLineStart(source, screenLine);
+
+    //find the first line with a row on screen and how many of its rows are above it
+    int firstLine = screenLineStart;
+    int firstLineSkip = 0;
+    int neededRows = 0;
+    for(int line = screenLineStart; line <= cursorLineEnd; line = segmentLineEnd(source, line) + 1){
+        loadSegmentLine(source, line, segmentLineEnd(source, line), line == cursorLineStart ? cursorOffset + 1 : 0);
+        breakLine();
+        neededRows += lineBreaks.size();
+    }
+    if(neededRows > rows){
+        int rowsBelow = 0;
+        for(int line = cursorLineStart; ; line = segmentLineStart(source, line - 1)){
+            loadSegmentLine(source, line, segmentLineEnd(source, line), line == cursorLineStart ? cursorOffset + 1 : 0);
+            breakLine();
+            int lineRows = lineBreaks.size();
+            if(rowsBelow + lineRows >= rows || line <= screenLineStart){
+                firstLine = line;
+                firstLineSkip = std::max(0, rowsBelow + lineRows - rows);
+                break;
+            }
+            rowsBelow += lineRows;
+        }
+    }
+
+    int screenRow = 0;
+    cursorColumn = 0;
+    cursorRow = 0;
+    for(int line = firstLine; line < source.endLine && screenRow < rows;){
+        int lastLine = segmentLineEnd(source, line);
+        loadSegmentLine(source, line, lastLine, line == cursorLineStart ? cursorOffset + 1 : 0);
+        breakLine();
+        for(size_t rowIndex = 0; rowIndex < lineBreaks.size(); rowIndex++){
+            if(line == firstLine && static_cast<int>(rowIndex) < firstLineSkip){
+                //rows of the first line pushed above the screen become history, as far as there's room
+                if(firstLineSkip - static_cast<int>(rowIndex) > scrollbackCapacity)
+                    continue;
+                writeLineRow(rowIndex, historySize);
+                historySize++;
+                continue;
+            }
+            if(screenRow == rows)
+                break;
+
+            writeLineRow(rowIndex, historySize + screenRow);
+            if(line == cursorLineStart){
+                size_t rowEnd = rowIndex + 1 < lineBreaks.size() ? lineBreaks[rowIndex + 1] : lineCells.size();
+                if(cursorOffset >= static_cast<size_t>(lineBreaks[rowIndex]) && cursorOffset < rowEnd){
+                    cursorRow = screenRow;
+                    cursorColumn = std::min(static_cast<int>(cursorOffset - lineBreaks[rowIndex]), columns - 1);
+                }
+            }
+            screenRow++;
+        }
+        line = lastLine + 1;
+    }
+    for(; screenRow < rows; screenRow++)
+        std::fill_n(getRow(screenRow), columns, blankCell());
+
+    //from firstLine on the segment is in the ring now, or didn't fit below the cursor
+    source.endLine = firstLine;
+
+    if(source.endLine == source.firstLine)
+        releaseNewestSegment();
+
+    //what's left of the old ring is usually just a few rows, they're cheaper to take now than to keep its storage around
+    while(!segments.empty() && segments.back().endLine - segments.back().firstLine <= rows * 2 && historySize < scrollbackCapacity)
+        pullHistoryLine();
+    limitSegments();
+}
+
+//moves the ring, storage and all, into a new history segment
+void Grid::freezeRing(){
+    HistorySegment segment;
+    segment.cells = std::move(cells);
+    segment.cellCapacity = cellCapacity;
+    segment.columns = columns;
+    segment.capacityRows = capacityRows;
+    segment.top = top;
+    segment.rowMap.swap(rowMap);
+    segment.wrapped.swap(wrapped);
+    segment.rowHasCombining.swap(rowHasCombining);
+    segment.combining.swap(combining);
+    segment.firstLine = 0;
+    segment.endLine = historySize + rows;
+    segments.push_back(std::move(segment));
+
+    cellCapacity = 0;
+    spareCombining.clear();
+}
+
+//storage for the ring at the current size, taken from the spare when it's big enough
+void Grid::allocateRing(){
+    size_t neededCells = static_cast<size_t>(capacityRows) * columns;
+    if(spareCells && spareCapacity >= neededCells && spareCapacity / 4 <= neededCells){
+        cells = std::move(spareCells);
+        cellCapacity = spareCapacity;
+    }else{
+        //slack so a window being dragged bigger doesn't reallocate every frame
+        cellCapacity = neededCells + neededCells / 4;
+        cells.reset(new Cell[cellCapacity]);
+    }
+    spareCells.reset();
+    spareCapacity = 0;
+
+    top = 0;
+    historySize = 0;
+    rowMap.resize(capacityRows);
+    for(int position = 0; position < capacityRows; position++)
+        rowMap[position] = position;
+    movedRows.resize(rows);
+    wrapped.assign(capacityRows, 0);
+    rowHasCombining.assign(capacityRows, 0);
+    dirty.assign(rows, 1);
+    damaged = true;
+}
+
+int Grid::segmentLineStart(const HistorySegment& segment, int lastLine){
+    int line = lastLine;
+    while(line > segment.firstLine && segment.isWrapped(line - 1))
+        line--;
+    return line;
+}
+
+int Grid::segmentLineEnd(const HistorySegment& segment, int firstLine){
+    int line = firstLine;
+    while(line < segment.endLine - 1 && segment.isWrapped(line))
+        line++;
+    return line;
+}
+
+/*
+    Joins the rows of a logical line into lineCells. Trailing blanks of wrapped rows
+    are part of the text, on the last row they're just empty and are trimmed, unless
+    minimumLength asks for them (the cursor may sit past the text).
+*/
+void Grid::loadSegmentLine(const HistorySegment& segment, int firstLine, int lastLine, size_t minimumLength){
+    lineCells.clear();
+    lineMarks.clear();
+
+    for(int line = firstLine; line <= lastLine; line++){
+        const Cell* row = segment.row(line);
+        int length = segment.columns;
+        if(line == lastLine && !segment.isWrapped(line)){
+            while(length > 0 && isBlank(row[length - 1]))
+                length--;
+        }
+
+        int storage = segment.storageRow(line);
+        if(segment.rowHasCombining[storage]){
+            for(int column = 0; column < length; column++){
+                if(!(row[column].flags & CELL_COMBINING))
+                    continue;
+                CombiningTable::const_iterator marks = segment.combining.find(static_cast<size_t>(storage) * segment.columns + column);
+                if(marks != segment.combining.end())
+                    lineMarks.emplace_back(lineCells.size() + column, &marks->second);
+            }
+        }
+        lineCells.insert(lineCells.end(), row, row + length);
+    }
+
+    if(lineCells.size() < minimumLength)
+        lineCells.resize(minimumLength, blankCell());
+}
+
+//fills lineBreaks for lineCells at the current width
+void Grid::breakLine(){
+    int length = lineCells.size();
+
+    lineBreaks.clear();
+    lineBreaks.push_back(0);
+    int rowStart = 0;
+    for(int i = 0; i < length;){
+        //a wide character that would be cut by the edge moves to the next row whole
+        int width = i + 1 < length && (lineCells[i + 1].flags & CELL_WIDE_CONTINUATION) ? 2 : 1;
+        if(i > rowStart && i + width - rowStart > columns){
+            rowStart = i;
+            lineBreaks.push_back(i);
+        }
+        i += width;
+    }
+}
+
+void Grid::writeLineRow(size_t rowIndex, int line){
+    int storage = storageRow(line);
+    int first = lineBreaks[rowIndex];
+    int end = rowIndex + 1 < lineBreaks.size() ? lineBreaks[rowIndex + 1] : lineCells.size();
+    int count = std::min(end - first, columns);
+
+    Cell* row = &cells[static_cast<size_t>(storage) * columns];
+    std::copy_n(lineCells.data() + first, count, row);
+    std::fill_n(row + count, columns - count, blankCell());
+    wrapped[storage] = rowIndex + 1 < lineBreaks.size();
+
+    for(const std::pair<int, const std::u32string*>& marks : lineMarks){
+        if(marks.first >= first && marks.first < first + count)
+            combiningEntry(storage, marks.first - first) = *marks.second;
+    }
+}
+
+//rewraps the newest waiting line and puts it in front of line 0, which the ring allows while the history isn't full
+void Grid::pullHistoryLine(){
+    HistorySegment& segment = segments.back();
+    int lastLine = segment.endLine - 1;
+    int firstLine = segmentLineStart(segment, lastLine);
+    loadSegmentLine(segment, firstLine, lastLine);
+    breakLine();
+
+    for(size_t rowIndex = lineBreaks.size(); rowIndex-- > 0 && historySize < scrollbackCapacity;){
+        top = top == 0 ? capacityRows - 1 : top - 1;
+        historySize++;
+        writeLineRow(rowIndex, 0);
+    }
+
+    segment.endLine = firstLine;
+    if(segment.endLine == segment.firstLine)
+        releaseNewestSegment();
+}
+
+//the biggest storage freed is kept so the next resize doesn't have to allocate
+void Grid::releaseNewestSegment(){
+    HistorySegment& segment = segments.back();
+    if(segment.cellCapacity > spareCapacity){
+        spareCells = std::move(segment.cells);
+        spareCapacity = segment.cellCapacity;
+    }
+    segments.pop_back();
+}
+
+//keeps the ring and the segments together within the scrollback limit, dropping the oldest lines first
+void Grid::limitSegments(){
+    int waiting = 0;
+    for(const HistorySegment& segment : segments)
+        waiting += segment.endLine - segment.firstLine;
+
+    int excess = historySize + waiting - scrollbackCapacity;
+    while(excess > 0 && !segments.empty()){
+        HistorySegment& oldest = segments.front();
+        int dropped = std::min(excess, oldest.endLine - oldest.firstLine);
+        oldest.firstLine += dropped;
+        excess -= dropped;
+        if(oldest.firstLine == oldest.endLine)
+            segments.erase(segments.begin());
+    }
+}
+
+void Grid::clearSegments(){
+    while(!segments.empty())
+        releaseNewestSegment();
+}
+
+void Grid::ensureHistory(int lines){
+    while(historySize < lines && historySize < scrollbackCapacity && !segments.empty())
+        pullHistoryLine();
+
+    //anything still waiting is older than a full history
+    if(historySize == scrollbackCapacity)
+        clearSegments();
+}
+
+int Grid::getColumns(){
+    return columns;
+}
+
+int Grid::getRows(){
+    return rows;
+}
+
+int Grid::getHistorySize(){
+    return historySize;
+}
+
+Cell* Grid::getRow(int row){
+    return &cells[static_cast<size_t>(screenStorageRow(row)) * columns];
+}
+
+const Cell* Grid::getViewRow(int row, int viewOffset){
+    return &cells[static_cast<size_t>(storageRow(historySize - viewOffset + row)) * columns];
+}
+
+Cell& Grid::getCell(int column, int row){
+    return getRow(row)[column];
+}
+
+bool Grid::isWrapped(int row){
+    return wrapped[screenStorageRow(row)];
+}
+
+void Grid::setWrapped(int row, bool isWrapped){
+    wrapped[screenStorageRow(row)] = isWrapped;
+}
+
+//finds or creates the side table entry for a cell, recycling a spare node when there is one
+std::u32string& Grid::combiningEntry(int storage, int column){
+    size_t index = static_cast<size_t>(storage) * columns + column;
+    CombiningTable::iterator found = combining.find(index);
+    if(found == combining.end()){
+        if(spareCombining.empty()){
+            found = combining.emplace(index, std::u32string()).first;
+        }else{
+            CombiningTable::node_type node = std::move(spareCombining.back());
+            spareCombining.pop_back();
+            node.key() = index;
+            found = combining.insert(std::move(node)).position;
+        }
+        rowHasCombining[storage] = 1;
+    }
+    return found->second;
+}
+
+void Grid::addCombining(int column, int row, char32_t mark){
+    int storage = screenStorageRow(row);
+    Cell& cell = cells[static_cast<size_t>(storage) * columns + column];
+    std::u32string& marks = combiningEntry(storage, column);
+
+    if(!(cell.flags & CELL_COMBINING)){
+        marks.clear();
+        cell.flags |= CELL_COMBINING;
+    }
+    if(marks.size() < MAX_COMBINING)
+        marks.push_back(mark);
+    markDirty(row);
+}
+
+const std::u32string& Grid::getViewCombining(int column, int row, int viewOffset){
+    static const std::u32string empty;
+    CombiningTable::const_iterator it = combining.find(static_cast<size_t>(storageRow(historySize - viewOffset + row)) * columns + column);
+    return it == combining.end() ? empty : it->second;
+}
+
+void Grid::clearRow(int row){
+    int storage = screenStorageRow(row);
+    std::fill_n(getRow(row), columns, blankCell());
+    wrapped[storage] = 0;
+    markDirty(row);
+
+    if(rowHasCombining[storage]){
+        for(int column = 0; column < columns; column++){
+            CombiningTable::node_type node = combining.extract(static_cast<size_t>(storage) * columns + column);
+            if(!node.empty())
+                spareCombining.push_back(std::move(node));
+        }
+        rowHasCombining[storage] = 0;
+    }
+}
+
+void Grid::clear(){
+    for(int row = 0; row < rows; row++)
+        clearRow(row);
+}
+
+void Grid::scrollUp(){
+    //the top screen row becomes history, when the history is full its oldest row is recycled
+    if(historySize < scrollbackCapacity){
+        historySize++;
+    }else{
+        top = ringPosition(1);
+        //lines waiting in segments are older than the row just recycled
+        if(!segments.empty())
+            clearSegments();
+    }
+
+    clearRow(rows - 1);
+    markAllDirty();
+}
+
+void Grid::scrollRegionUp(int first, int last, int lines){
+    lines = std::min(lines, last - first + 1);
+    if(lines <= 0)
+        return;
+
+    //the rows scrolled out of the region are reused as the cleared rows at its bottom
+    for(int i = 0; i < lines; i++)
+        movedRows[i] = screenRowEntry(first + i);
+    for(int row = first; row + lines <= last; row++)
+        screenRowEntry(row) = screenRowEntry(row + lines);
+    for(int i = 0; i < lines; i++){
+        screenRowEntry(last - lines + 1 + i) = movedRows[i];
+        clearRow(last - lines + 1 + i);
+    }
+
+    //lines that continued across an edge of the region were cut there
+    if(first > 0)
+        setWrapped(first - 1, false);
+    if(lines <= last - first)
+        setWrapped(last - lines, false);
+    for(int row = first; row <= last; row++)
+        markDirty(row);
+}
+
+void Grid::scrollRegionDown(int first, int last, int lines){
+    lines = std::min(lines, last - first + 1);
+    if(lines <= 0)
+        return;
+
+    for(int i = 0; i < lines; i++)
+        movedRows[i] = screenRowEntry(last - i);
+    for(int row = last; row - lines >= first; row--)
+        screenRowEntry(row) = screenRowEntry(row - lines);
+    for(int i = 0; i < lines; i++){
+        screenRowEntry(first + i) = movedRows[i];
+        clearRow(first + i);
+    }
+
+    if(first > 0)
+        setWrapped(first - 1, false);
+    setWrapped(last, false);
+    for(int row = first; row <= last; row++)
+        markDirty(row);
+}
+
+void Grid::markDirty(int row){
+    dirty[row] = 1;
+    damaged = true;
+}
+
+void Grid::markAllDirty(){
+    std::fill(dirty.begin(), dirty.end(), 1);
+    damaged = true;
+}
+
+bool Grid::isDirty(int row){
+    return dirty[row];
+}
+
+bool Grid::hasDamage(){
+    return damaged;
+}
+
+void Grid::clearDamage(){
+    std::fill(dirty.begin(), dirty.end(), 0);
+    damaged = false;
+}
@@ -2,9 +2,11 @@
 #include <SDL3/SDL_main.h>
 #include <string>
 #include <filesystem>
+#include <sys/resource.h>
 
 #include "../include/paths.h"
 #include "../include/terminal.h"
+#include "../include/perf_monitor.h"
 
 bool init();
 void mainLoop();
@@ -13,22 +15,77 @@ bool handleEvent(SDL_Event event);
 char getAsciiCode(SDL_Keycode keycode);
 std::string getCodeSequence(SDL_Keycode keycode);
 void sendAsciiCharacter(SDL_Keycode keycode);
+void pasteClipboard();
 void handleKeypadInput(SDL_Keycode keycode);
 bool uninstall();
+void reportLoopStats(bool force = false);
+void logStartupPhase(const char* phase, Uint64& phaseStartNS); //logs the time since phaseStartNS and moves it to now
+Uint64 getCpuTimeUS();
 
 std::string windowTitle = "Abram's Tiny Term";
 
 SDL_Window* window{nullptr};
 SDL_Renderer* renderer{nullptr};
 Terminal* term{nullptr};
+//set by window events that need a present even when the terminal itself is unchanged
+bool windowNeedsRedraw{true};
+//a drag sends many resize events per frame, only the last size is applied, once per loop iteration
+bool resizePending{false};
+
+//when main() was entered, startup phases and the first output on screen are timed from here
+Uint64 startNS{0};
+//the first frame with shell output in it has been presented, i.e. the prompt is up
+bool firstOutputPresented{false};
+
+Uint32 ptyReadyEvent{0};
+bool ptyReady{false};
+
+//enabled with --stats, logs how often the loop wakes and how much CPU it uses
+struct LoopStats{
+    bool enabled;
+    Uint64 wakes;
+    Uint64 framesPresented;
+    Uint64 framesSkipped;
+    Uint64 lastReportNS;
+    Uint64 lastCpuUS;
+    Uint64 lastBytesRead;
+};
+LoopStats loopStats{false, 0, 0, 0, 0, 0, 0};
+const Uint64 STATS_INTERVAL_NS = 5 * SDL_NS_PER_SECOND;
+
+//per frame counters, shown with ctrl + shift + F12 (or --hud) and written to --perf-csv
+PerfMonitor perfMonitor;
+
+//--record file saves the session as asciicast, --replay file [--fast] plays one back instead of a shell
+std::string recordPath;
+std::string replayPath;
+bool replayFast{false};
 
 int main(int argc, char* args[]){
-    if(argc > 1){
-        std::string arg2 = args[1];
-        if(arg2 == "--uninstall"){
+    startNS = SDL_GetTicksNS();
+
+    for(int i = 1; i < argc; i++){
+        std::string arg = args[i];
+        if(arg == "--uninstall"){
             if(!uninstall())
                 return 1;
             return 0;
+        }else if(arg == "--stats"){
+            loopStats.enabled = true;
+        }else if(arg == "--record" && i + 1 < argc){
+            recordPath = args[++i];
+        }else if(arg == "--replay" && i + 1 < argc){
+            replayPath = args[++i];
+        }else if(arg == "--fast"){
+            replayFast = true;
+        }else if(arg == "--hud"){
+            perfMonitor.toggle();
+        }else if(arg == "--perf-csv" && i + 1 < argc){
+            if(!perfMonitor.openCsv(args[++i]))
+                return 1;
+        }else{
+            SDL_Log("Unknown argument: %s\n", arg.c_str());
+            return 1;
         }
     }
 
@@ -46,7 +103,25 @@ int main(int argc, char* args[]){
     return 0;
 }
 
+/*
+    The shell is started before anything else, so its rc files run while the
+    window, the font and the render target are being set up. Each phase is
+    logged, and mainLoop() logs when the first output is on screen.
+*/
 bool init(){
+    Uint64 phaseStartNS = startNS;
+
+    term = new Terminal();
+    if(!recordPath.empty())
+        term->setRecordPath(recordPath);
+    if(!replayPath.empty())
+        term->setReplay(replayPath, replayFast);
+    if(!term->start()){
+        SDL_Log("Failed to start the shell!\n");
+        return false;
+    }
+    logStartupPhase("config and shell", phaseStartNS);
+
     if(!SDL_Init(SDL_INIT_VIDEO)){
         SDL_Log("SDL could not initialize! SDL error: %s\n", SDL_GetError());
         return false;
@@ -56,21 +131,46 @@ bool init(){
         SDL_Log("Window or renderer could not be created! SDL error: %s\n", SDL_GetError());
         return false;
     }
+    logStartupPhase("window", phaseStartNS);
 
-    term = new Terminal(renderer);
-    if(!term->init()){
+    if(!term->init(renderer)){
         SDL_Log("Failed to initialize terminal!\n");
         return false;
     }
+    logStartupPhase("font and render target", phaseStartNS);
 
     term->setPadding(0,2);
 
     SDL_SetWindowSize(window, term->getPixelWidth(), term->getPixelHeight());
 
+    if(term->getVsync() && !SDL_SetRenderVSync(renderer, 1))
+        SDL_Log("Could not enable vsync: %s\n", SDL_GetError());
+
+    if(!(ptyReadyEvent = SDL_RegisterEvents(1))){
+        SDL_Log("Could not register PTY event: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if(!term->startReader(ptyReadyEvent)){
+        SDL_Log("Failed to start PTY reader!\n");
+        return false;
+    }
+    logStartupPhase("reader", phaseStartNS);
+
+    SDL_Log("Startup took %.2fms\n", (SDL_GetTicksNS() - startNS) / 1e6);
     return true;
 }
 
+void logStartupPhase(const char* phase, Uint64& phaseStartNS){
+    Uint64 now = SDL_GetTicksNS();
+    SDL_Log("Startup: %s %.2fms\n", phase, (now - phaseStartNS) / 1e6);
+    phaseStartNS = now;
+}
+
 void close(){
+    delete term;
+    term = nullptr;
+
     SDL_DestroyRenderer(renderer);
     renderer = nullptr;
     SDL_DestroyWindow(window);
@@ -85,40 +185,196 @@ void mainLoop(){
     SDL_Event event;
     SDL_zero(event);
 
+    Uint64 frameIntervalNS = 0;
+    if(term->getMaxFPS() > 0)
+        frameIntervalNS = SDL_NS_PER_SECOND / term->getMaxFPS();
+    Uint64 lastFrameNS = 0;
+    //due frames put off for parsing since the last present, see below
+    uint64_t framesSkipped = 0;
+    //the due frame has already been counted in framesSkipped, cleared on present
+    bool frameDeferred = false;
+
+    loopStats.lastReportNS = SDL_GetTicksNS();
+    loopStats.lastCpuUS = getCpuTimeUS();
+    loopStats.lastBytesRead = term->getBytesRead();
+
     while(!quit){
-        //get event data
-        while(SDL_PollEvent(&event)){
-            if(event.type == SDL_EVENT_QUIT){
+        /* sleep until there is an event or PTY output, or until the frame cap
+         * allows the pending frame to be drawn */
+        bool renderPending = windowNeedsRedraw || term->needsRender();
+        Sint32 timeoutMS = -1;
+        if(ptyReady){
+            timeoutMS = 0;
+        }else if(renderPending){
+            Uint64 now = SDL_GetTicksNS();
+            Uint64 nextFrameNS = lastFrameNS + frameIntervalNS;
+            timeoutMS = now >= nextFrameNS ? 0 : static_cast<Sint32>((nextFrameNS - now + SDL_NS_PER_MS - 1) / SDL_NS_PER_MS);
+        }else if(Uint64 deadlineNS = term->getSynchronizedDeadlineNS()){
+            //a held frame has to be shown once its synchronized update times out, even if nothing else happens
+            Uint64 now = SDL_GetTicksNS();
+            timeoutMS = now >= deadlineNS ? 0 : static_cast<Sint32>((deadlineNS - now + SDL_NS_PER_MS - 1) / SDL_NS_PER_MS);
+        }
+        if(loopStats.enabled){
+            Sint32 reportTimeoutMS = static_cast<Sint32>(STATS_INTERVAL_NS / SDL_NS_PER_MS);
+            if(timeoutMS < 0 || timeoutMS > reportTimeoutMS)
+                timeoutMS = reportTimeoutMS;
+        }
+
+        bool gotEvent = timeoutMS < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, timeoutMS);
+        if(gotEvent){
+            loopStats.wakes++;
+            do{
+                if(event.type == SDL_EVENT_QUIT){
+                    quit = true;
+                } else if(event.type == ptyReadyEvent){
+                    ptyReady = true;
+                } else {
+                    if(!handleEvent(event))
+                        SDL_Log("Error handling event: %i\n", event.type);
+                }
+            }while(SDL_PollEvent(&event));
+        }
+
+        if(resizePending){
+            resizePending = false;
+            int newWidth, newHeight;
+            if(!SDL_GetWindowSize(window, &newWidth, &newHeight) || !term->updateDimensions(newWidth, newHeight))
+                SDL_Log("Error resizing the terminal: %s\n", SDL_GetError());
+        }
+
+        //update() returns true when its budget ran out, so keep going without waiting
+        if(ptyReady){
+            ptyReady = term->update();
+            //a replayed resize, the window follows the terminal instead of the other way around
+            if(term->takeSizeChange())
+                SDL_SetWindowSize(window, term->getPixelWidth(), term->getPixelHeight());
+            if(!term->isRunning())
                 quit = true;
-            } else {
-                if(!handleEvent(event))
-                    SDL_Log("Error handling event: %i\n", event.type);
+        }
+
+        //everything typed or answered this iteration goes out together
+        term->flushInput();
+
+        reportLoopStats();
+
+        if(!windowNeedsRedraw && !term->needsRender())
+            continue;
+
+        Uint64 now = SDL_GetTicksNS();
+        Uint64 frameDueNS = lastFrameNS + frameIntervalNS;
+        if(now < frameDueNS)
+            continue;
+
+        /* during an output flood the states in between are never seen, so while more
+         * is waiting to be parsed the frame is put off, up to the latency budget, to
+         * show a later state. Echo of typed input is parsed in one go and isn't held */
+        if(ptyReady && !windowNeedsRedraw && now < frameDueNS + term->getFloodLatencyNS()){
+            //a frame is put off over several parse passes but only counted once
+            if(!frameDeferred){
+                frameDeferred = true;
+                framesSkipped++;
+                loopStats.framesSkipped++;
             }
+            continue;
         }
+        lastFrameNS = now;
+        frameDeferred = false;
 
         SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
         SDL_RenderClear(renderer);
 
-        term->update();
         term->render(0,0);
+        if(perfMonitor.isVisible())
+            term->drawOverlay(perfMonitor.getLines());
+        Uint64 renderedNS = SDL_GetTicksNS();
 
         SDL_RenderPresent(renderer);
+        windowNeedsRedraw = false;
+        loopStats.framesPresented++;
+
+        FrameStats frameStats = term->takeFrameStats();
+        frameStats.framesSkipped = framesSkipped;
+        frameStats.renderNS = renderedNS - now;
+        frameStats.presentNS = SDL_GetTicksNS() - renderedNS;
+        framesSkipped = 0;
+
+        if(!firstOutputPresented && frameStats.bytesParsed > 0){
+            firstOutputPresented = true;
+            SDL_Log("First output on screen after %.2fms\n", (SDL_GetTicksNS() - startNS) / 1e6);
+        }
+        //new HUD text needs another frame to show up
+        if(perfMonitor.endFrame(frameStats) && perfMonitor.isVisible())
+            windowNeedsRedraw = true;
     }
+
+    reportLoopStats(true);
+}
+
+void reportLoopStats(bool force){
+    if(!loopStats.enabled)
+        return;
+
+    Uint64 now = SDL_GetTicksNS();
+    Uint64 elapsedNS = now - loopStats.lastReportNS;
+    if(!force && elapsedNS < STATS_INTERVAL_NS)
+        return;
+
+    Uint64 cpuUS = getCpuTimeUS();
+
+    double seconds = elapsedNS / static_cast<double>(SDL_NS_PER_SECOND);
+    double cpuPercent = seconds > 0 ? (cpuUS - loopStats.lastCpuUS) / 10000.0 / seconds : 0;
+    Uint64 bytesRead = term->getBytesRead() - loopStats.lastBytesRead;
+    SDL_Log("Loop stats: %.1fs, %llu wakes (%.1f/s), %llu frames presented, %llu skipped, %.1f%% CPU, %.2f MB/s PTY output\n",
+            seconds,
+            static_cast<unsigned long long>(loopStats.wakes), loopStats.wakes / seconds,
+            static_cast<unsigned long long>(loopStats.framesPresented),
+            static_cast<unsigned long long>(loopStats.framesSkipped),
+            cpuPercent,
+            bytesRead / seconds / (1024.0 * 1024.0));
+
+    loopStats.wakes = 0;
+    loopStats.framesPresented = 0;
+    loopStats.framesSkipped = 0;
+    loopStats.lastReportNS = now;
+    loopStats.lastCpuUS = cpuUS;
+    loopStats.lastBytesRead = term->getBytesRead();
+}
+
+Uint64 getCpuTimeUS(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000000ull + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1000000ull + usage.ru_stime.tv_usec;
 }
 
 bool handleEvent(SDL_Event event){
     switch (event.type){
         case SDL_EVENT_WINDOW_RESIZED:
-            {
-                int newWidth, newHeight;
-                if(!SDL_GetWindowSize(window, &newWidth, &newHeight))
-                    return false;
-                term->updateDimensions(newWidth, newHeight);
-                break;
-            }
+            resizePending = true;
+            windowNeedsRedraw = true;
+            break;
+        case SDL_EVENT_WINDOW_EXPOSED:
+            windowNeedsRedraw = true;
+            break;
+        case SDL_EVENT_RENDER_TARGETS_RESET:
+        case SDL_EVENT_RENDER_DEVICE_RESET:
+            term->invalidate();
+            windowNeedsRedraw = true;
+            break;
+        case SDL_EVENT_MOUSE_WHEEL:
+            term->scrollView(static_cast<int>(event.wheel.y * 3));
+            break;
         case SDL_EVENT_KEY_DOWN:
             {
-                if(event.key.key <= SDLK_TILDE){
+                //shift + page up/down scrolls through the history instead of going to the shell
+                if(event.key.mod & SDL_KMOD_SHIFT && (event.key.key == SDLK_PAGEUP || event.key.key == SDLK_PAGEDOWN)){
+                    term->scrollViewPages(event.key.key == SDLK_PAGEUP ? 1 : -1);
+                }else if(event.key.mod & SDL_KMOD_CTRL && event.key.mod & SDL_KMOD_SHIFT && event.key.key == SDLK_F12){
+                    perfMonitor.toggle();
+                    windowNeedsRedraw = true;
+                }else if((event.key.mod & SDL_KMOD_CTRL && event.key.mod & SDL_KMOD_SHIFT && event.key.key == SDLK_V)
+                        || (event.key.mod & SDL_KMOD_SHIFT && event.key.key == SDLK_INSERT)){
+                    pasteClipboard();
+                }else if(event.key.key <= SDLK_TILDE){
                     sendAsciiCharacter(event.key.key);
                 }else if(event.key.key >= SDLK_KP_DIVIDE && event.key.key <= SDLK_KP_EQUALS){
                     handleKeypadInput(event.key.key);
@@ -254,6 +510,16 @@ void sendAsciiCharacter(SDL_Keycode keycode){
     term->sendChar(getAsciiCode(keycode));
 }
 
+void pasteClipboard(){
+    char* text = SDL_GetClipboardText();
+    if(!text){
+        SDL_Log("Unable to get clipboard text: %s\n", SDL_GetError());
+        return;
+    }
+    term->paste(text);
+    SDL_free(text);
+}
+
 void handleKeypadInput(SDL_Keycode keycode){
     //handle NUM LOCK
     if(SDL_GetModState() & SDL_KMOD_NUM){
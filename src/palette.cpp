@@ -0,0 +1,51 @@
+#include "../include/palette.h"
+
+const int DEFAULT_THEME[16] = {
+    0x000000, 0xCD0000, 0x00CD00, 0xCDCD00, 0x0000EE, 0xCD00CD, 0x00CDCD, 0xE5E5E5,
+    0x7F7F7F, 0xFF0000, 0x00FF00, 0xFFFF00, 0x5C5CFF, 0xFF00FF, 0x00FFFF, 0xFFFFFF
+};
+
+//channel values of the 6 steps of the color cube
+static const unsigned int CUBE_LEVELS[6] = {0x00, 0x5F, 0x87, 0xAF, 0xD7, 0xFF};
+
+static unsigned int nearestCubeLevel(unsigned int value){
+    //midpoints between the levels
+    if(value < 0x30) return 0;
+    if(value < 0x73) return 1;
+    return (value - 0x23) / 0x28;
+}
+
+static unsigned int distance(unsigned int red, unsigned int green, unsigned int blue, unsigned int r, unsigned int g, unsigned int b){
+    int dr = static_cast<int>(red) - static_cast<int>(r);
+    int dg = static_cast<int>(green) - static_cast<int>(g);
+    int db = static_cast<int>(blue) - static_cast<int>(b);
+    return dr * dr + dg * dg + db * db;
+}
+
+uint32_t paletteColor(int index, const int theme[16]){
+    if(index < 16)
+        return theme[index];
+
+    if(index < 232){
+        index -= 16;
+        return CUBE_LEVELS[index / 36] << 16 | CUBE_LEVELS[index / 6 % 6] << 8 | CUBE_LEVELS[index % 6];
+    }
+
+    unsigned int gray = 8 + (index - 232) * 10;
+    return gray << 16 | gray << 8 | gray;
+}
+
+uint8_t nearestPaletteColor(unsigned int red, unsigned int green, unsigned int blue){
+    unsigned int r = nearestCubeLevel(red), g = nearestCubeLevel(green), b = nearestCubeLevel(blue);
+    unsigned int cubeDistance = distance(red, green, blue, CUBE_LEVELS[r], CUBE_LEVELS[g], CUBE_LEVELS[b]);
+
+    //the ramp runs from 8 to 238 in steps of 10
+    unsigned int average = (red + green + blue) / 3;
+    unsigned int step = average < 8 ? 0 : average > 238 ? 23 : (average - 3) / 10;
+    unsigned int gray = 8 + step * 10;
+    unsigned int grayDistance = distance(red, green, blue, gray, gray, gray);
+
+    if(grayDistance < cubeDistance)
+        return 232 + step;
+    return 16 + r * 36 + g * 6 + b;
+}
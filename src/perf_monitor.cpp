@@ -0,0 +1,105 @@
+#include "../include/perf_monitor.h"
+
+PerfMonitor::PerfMonitor()
+    : visible(false),
+    frameNumber(0),
+    startNS(SDL_GetTicksNS()),
+    lastFrameNS(startNS),
+    totals{},
+    framesInInterval(0),
+    intervalStartNS(startNS),
+    lines{"perf: waiting for a frame"}
+{}
+
+bool PerfMonitor::openCsv(const std::string& path){
+    csv.open(path);
+    if(!csv.is_open()){
+        SDL_Log("Unable to open perf CSV file: %s\n", path.c_str());
+        return false;
+    }
+
+    csv << "frame,time_ms,frame_ms,bytes_read,bytes_parsed,escape_sequences,cells_drawn,draw_calls,frames_skipped,parse_us,render_us,present_us\n";
+    return true;
+}
+
+void PerfMonitor::toggle(){
+    visible = !visible;
+}
+
+bool PerfMonitor::isVisible(){
+    return visible;
+}
+
+bool PerfMonitor::endFrame(const FrameStats& stats){
+    Uint64 now = SDL_GetTicksNS();
+    Uint64 frameNS = now - lastFrameNS;
+    lastFrameNS = now;
+    frameNumber++;
+
+    if(csv.is_open()){
+        char row[256];
+        snprintf(row, sizeof(row), "%llu,%.3f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f\n",
+                static_cast<unsigned long long>(frameNumber),
+                (now - startNS) / 1e6,
+                frameNS / 1e6,
+                static_cast<unsigned long long>(stats.bytesRead),
+                static_cast<unsigned long long>(stats.bytesParsed),
+                static_cast<unsigned long long>(stats.escapeSequences),
+                static_cast<unsigned long long>(stats.cellsDrawn),
+                static_cast<unsigned long long>(stats.drawCalls),
+                static_cast<unsigned long long>(stats.framesSkipped),
+                stats.parseNS / 1e3,
+                stats.renderNS / 1e3,
+                stats.presentNS / 1e3);
+        csv << row;
+    }
+
+    totals.bytesRead += stats.bytesRead;
+    totals.bytesParsed += stats.bytesParsed;
+    totals.escapeSequences += stats.escapeSequences;
+    totals.cellsDrawn += stats.cellsDrawn;
+    totals.drawCalls += stats.drawCalls;
+    totals.framesSkipped += stats.framesSkipped;
+    totals.parseNS += stats.parseNS;
+    totals.renderNS += stats.renderNS;
+    totals.presentNS += stats.presentNS;
+    framesInInterval++;
+
+    Uint64 intervalNS = now - intervalStartNS;
+    if(intervalNS < HUD_INTERVAL_NS)
+        return false;
+
+    //kept short, the default window is only 32 columns wide
+    double seconds = intervalNS / static_cast<double>(SDL_NS_PER_SECOND);
+    double frames = static_cast<double>(framesInInterval);
+    char line[64];
+    lines.clear();
+
+    snprintf(line, sizeof(line), "fps %.1f frame %.2fms", frames / seconds, seconds * 1e3 / frames);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "read %.2f MB/s", totals.bytesRead / seconds / (1024.0 * 1024.0));
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "parsed %.2f MB/s", totals.bytesParsed / seconds / (1024.0 * 1024.0));
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "escapes %.0f/s", totals.escapeSequences / seconds);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "cells %.0f draws %.1f /frame", totals.cellsDrawn / frames, totals.drawCalls / frames);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "skipped %.1f/s %.0fKB /frame", totals.framesSkipped / seconds, totals.bytesParsed / 1024.0 / frames);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "parse %.2fms /frame", totals.parseNS / 1e6 / frames);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "render %.2fms /frame", totals.renderNS / 1e6 / frames);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "present %.2fms /frame", totals.presentNS / 1e6 / frames);
+    lines.push_back(line);
+
+    totals = FrameStats{};
+    framesInInterval = 0;
+    intervalStartNS = now;
+    return true;
+}
+
+const std::vector<std::string>& PerfMonitor::getLines(){
+    return lines;
+}
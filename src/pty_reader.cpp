@@ -0,0 +1,161 @@
+#include "../include/pty_reader.h"
+
+PtyReader::PtyReader()
+    : fd(-1),
+    eventType(0),
+    ring(nullptr),
+    recorder(nullptr),
+    wakePipe{-1, -1},
+    thread(nullptr),
+    running(false),
+    notified(false),
+    waitingForSpace(false),
+    waitingForWritable(false),
+    exited(false),
+    bytesRead(0)
+{}
+
+PtyReader::~PtyReader(){
+    stop();
+}
+
+bool PtyReader::start(int fd, SpscRing* ring, Uint32 eventType){
+    this->fd = fd;
+    this->ring = ring;
+    this->eventType = eventType;
+
+    if(pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) == -1){
+        SDL_Log("Unable to create PTY reader wake pipe\n");
+        return false;
+    }
+
+    running = true;
+    if(!(thread = SDL_CreateThread(threadFunction, "pty_reader", this))){
+        SDL_Log("Unable to create PTY reader thread: %s\n", SDL_GetError());
+        running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void PtyReader::stop(){
+    if(thread){
+        running = false;
+        wake();
+        SDL_WaitThread(thread, nullptr);
+        thread = nullptr;
+    }
+
+    for(int& pipeFD : wakePipe){
+        if(pipeFD != -1){
+            close(pipeFD);
+            pipeFD = -1;
+        }
+    }
+}
+
+void PtyReader::setRecorder(SessionRecorder* recorder){
+    this->recorder = recorder;
+}
+
+void PtyReader::acknowledge(){
+    notified = false;
+}
+
+void PtyReader::spaceAvailable(){
+    if(waitingForSpace.exchange(false))
+        wake();
+}
+
+void PtyReader::watchWritable(){
+    if(!waitingForWritable.exchange(true))
+        wake();
+}
+
+bool PtyReader::hasExited(){
+    return exited;
+}
+
+uint64_t PtyReader::getBytesRead(){
+    return bytesRead.load(std::memory_order_relaxed);
+}
+
+void PtyReader::wake(){
+    char byte = 0;
+    write(wakePipe[1], &byte, 1);
+}
+
+void PtyReader::notify(){
+    if(!notified.exchange(true)){
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = eventType;
+        SDL_PushEvent(&event);
+    }
+}
+
+int PtyReader::threadFunction(void* data){
+    static_cast<PtyReader*>(data)->readLoop();
+    return 0;
+}
+
+void PtyReader::readLoop(){
+    while(running && !exited){
+        size_t freeBytes;
+        char* destination = ring->writableSpan(freeBytes);
+
+        //backpressure, park until the consumer frees space. Checking again after
+        //setting the flag closes the race with a consumer that just emptied the ring
+        bool readable = freeBytes > 0;
+        if(!readable){
+            waitingForSpace = true;
+            destination = ring->writableSpan(freeBytes);
+            if(freeBytes > 0){
+                waitingForSpace = false;
+                readable = true;
+            }
+        }
+
+        //a negative fd is ignored by poll, so a parked reader with no input waiting only listens for the wake pipe
+        short events = (readable ? POLLIN : 0) | (waitingForWritable ? POLLOUT : 0);
+        struct pollfd fds[2] = {
+            {wakePipe[0], POLLIN, 0},
+            {events ? fd : -1, events, 0}
+        };
+
+        if(poll(fds, 2, -1) == -1){
+            if(errno == EINTR)
+                continue;
+            SDL_Log("PTY reader poll failed\n");
+            break;
+        }
+
+        if(fds[0].revents & POLLIN){
+            char drain[64];
+            while(read(wakePipe[0], drain, sizeof(drain)) > 0);
+        }
+
+        //a hangup ends the wait too, the main thread's next write finds out why
+        if((fds[1].revents & (POLLOUT | POLLHUP | POLLERR)) && waitingForWritable.exchange(false))
+            notify();
+
+        if(!readable || !(fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+
+        ssize_t result = read(fd, destination, freeBytes);
+        if(result > 0){
+            ring->commitWrite(result);
+            bytesRead.fetch_add(result, std::memory_order_relaxed);
+            notify();
+            //only this thread writes the ring, so the bytes stay put while they are recorded
+            if(recorder)
+                recorder->record(destination, result);
+        }else if(result == 0 || (errno != EAGAIN && errno != EINTR)){
+            //the master reads EIO (or EOF) once every process holding the slave side is gone
+            exited = true;
+            notified = false;
+            notify();
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#include "../include/session_player.h"
+
+//longest the playback thread blocks before checking whether it was stopped
+static const Uint64 POLL_INTERVAL_NS = 100 * SDL_NS_PER_MS;
+
+static void appendUtf8(std::string& output, char32_t codepoint){
+    if(codepoint < 0x80){
+        output += static_cast<char>(codepoint);
+    }else if(codepoint < 0x800){
+        output += static_cast<char>(0xC0 | (codepoint >> 6));
+        output += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }else if(codepoint < 0x10000){
+        output += static_cast<char>(0xE0 | (codepoint >> 12));
+        output += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        output += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }else{
+        output += static_cast<char>(0xF0 | (codepoint >> 18));
+        output += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        output += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        output += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+static int getHeaderNumber(const std::string& header, const std::string& key, int defaultValue){
+    size_t position = header.find("\"" + key + "\"");
+    if(position == std::string::npos)
+        return defaultValue;
+
+    position = header.find(':', position);
+    if(position == std::string::npos)
+        return defaultValue;
+
+    return std::atoi(header.c_str() + position + 1);
+}
+
+SessionPlayer::SessionPlayer()
+    : columns(0),
+    rows(0),
+    fd(-1),
+    fast(false),
+    thread(nullptr),
+    running(false)
+{}
+
+SessionPlayer::~SessionPlayer(){
+    stop();
+}
+
+/*
+    position starts on the opening quote and ends just past the closing one.
+    \u escapes are converted to UTF-8, surrogate pairs included.
+*/
+bool SessionPlayer::decodeString(const std::string& line, size_t& position, std::string& output){
+    if(position >= line.size() || line[position] != '"')
+        return false;
+    position++;
+
+    while(position < line.size()){
+        char character = line[position++];
+        if(character == '"')
+            return true;
+        if(character != '\\'){
+            output += character;
+            continue;
+        }
+
+        if(position >= line.size())
+            return false;
+        char escape = line[position++];
+        switch(escape){
+            case 'n': output += '\n'; break;
+            case 'r': output += '\r'; break;
+            case 't': output += '\t'; break;
+            case 'b': output += '\b'; break;
+            case 'f': output += '\f'; break;
+            case 'u':
+                {
+                    if(position + 4 > line.size())
+                        return false;
+                    char32_t codepoint = std::strtoul(line.substr(position, 4).c_str(), nullptr, 16);
+                    position += 4;
+
+                    bool highSurrogate = codepoint >= 0xD800 && codepoint <= 0xDBFF;
+                    if(highSurrogate && position + 6 <= line.size() && line[position] == '\\' && line[position + 1] == 'u'){
+                        char32_t low = std::strtoul(line.substr(position + 2, 4).c_str(), nullptr, 16);
+                        position += 6;
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(output, codepoint);
+                    break;
+                }
+            default: output += escape; break; //covers \" \\ and \/
+        }
+    }
+
+    return false;
+}
+
+bool SessionPlayer::load(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()){
+        SDL_Log("Unable to open recording: %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    if(!std::getline(file, line) || getHeaderNumber(line, "version", 0) != 2){
+        SDL_Log("%s is not an asciicast v2 recording\n", path.c_str());
+        return false;
+    }
+    columns = getHeaderNumber(line, "width", 80);
+    rows = getHeaderNumber(line, "height", 24);
+
+    data.clear();
+    events.clear();
+    resizes.clear();
+    int lineNumber = 1;
+    while(std::getline(file, line)){
+        lineNumber++;
+        if(line.empty())
+            continue;
+
+        //[time, "type", "data"], anything other than output and resizes is skipped
+        char* numberEnd = nullptr;
+        double seconds = std::strtod(line.c_str() + 1, &numberEnd);
+        size_t position = line.find('"', numberEnd - line.c_str());
+        std::string type;
+        if(line[0] != '[' || !decodeString(line, position, type)){
+            SDL_Log("Skipping malformed event on line %d of %s\n", lineNumber, path.c_str());
+            continue;
+        }
+        if(type != "o" && type != "r")
+            continue;
+
+        position = line.find('"', position);
+        if(type == "r"){
+            //"COLUMNSxROWS", applied after the output recorded before it
+            std::string size;
+            int newColumns, newRows;
+            if(!decodeString(line, position, size) || std::sscanf(size.c_str(), "%dx%d", &newColumns, &newRows) != 2 || newColumns < 1 || newRows < 1){
+                SDL_Log("Skipping malformed event on line %d of %s\n", lineNumber, path.c_str());
+                continue;
+            }
+            resizes.push_back({data.size(), newColumns, newRows});
+            continue;
+        }
+
+        size_t offset = data.size();
+        if(!decodeString(line, position, data)){
+            data.resize(offset);
+            SDL_Log("Skipping malformed event on line %d of %s\n", lineNumber, path.c_str());
+            continue;
+        }
+
+        events.push_back({static_cast<Uint64>(seconds * SDL_NS_PER_SECOND), offset, data.size() - offset});
+    }
+
+    SDL_Log("Loaded %zu events, %zu resizes, %zu bytes from %s\n", events.size(), resizes.size(), data.size(), path.c_str());
+    return true;
+}
+
+int SessionPlayer::getColumns(){
+    return columns;
+}
+
+int SessionPlayer::getRows(){
+    return rows;
+}
+
+const std::vector<SessionPlayer::Resize>& SessionPlayer::getResizes(){
+    return resizes;
+}
+
+bool SessionPlayer::start(int fd, bool fast){
+    this->fd = fd;
+    this->fast = fast;
+
+    running = true;
+    if(!(thread = SDL_CreateThread(threadFunction, "session_player", this))){
+        SDL_Log("Unable to create replay thread: %s\n", SDL_GetError());
+        running = false;
+        //the caller still owns fd
+        this->fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void SessionPlayer::stop(){
+    if(thread){
+        running = false;
+        SDL_WaitThread(thread, nullptr);
+        thread = nullptr;
+    }
+
+    if(fd != -1){
+        close(fd);
+        fd = -1;
+    }
+}
+
+int SessionPlayer::threadFunction(void* data){
+    static_cast<SessionPlayer*>(data)->playLoop();
+    return 0;
+}
+
+bool SessionPlayer::writeAll(const char* bytes, size_t length){
+    while(length > 0){
+        if(!running)
+            return false;
+
+        ssize_t written = write(fd, bytes, length);
+        if(written > 0){
+            bytes += written;
+            length -= written;
+            continue;
+        }
+        if(errno == EINTR)
+            continue;
+        if(errno != EAGAIN)
+            return false;
+
+        //the pipe is full, the reader is behind
+        struct pollfd writable = {fd, POLLOUT, 0};
+        poll(&writable, 1, POLL_INTERVAL_NS / SDL_NS_PER_MS);
+    }
+
+    return true;
+}
+
+void SessionPlayer::playLoop(){
+    Uint64 startNS = SDL_GetTicksNS();
+
+    for(const Event& event : events){
+        if(!fast){
+            Uint64 now;
+            while(running && (now = SDL_GetTicksNS()) - startNS < event.timeNS)
+                SDL_DelayNS(std::min(event.timeNS - (now - startNS), POLL_INTERVAL_NS));
+        }
+
+        if(!writeAll(data.data() + event.offset, event.length))
+            break;
+    }
+
+    if(running){
+        double seconds = (SDL_GetTicksNS() - startNS) / static_cast<double>(SDL_NS_PER_SECOND);
+        SDL_Log("Replay finished in %.3fs, %.2f MB/s\n", seconds, data.size() / seconds / (1024.0 * 1024.0));
+    }
+
+    //closing the write end is what ends the session
+    close(fd);
+    fd = -1;
+}
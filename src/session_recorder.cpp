@@ -0,0 +1,246 @@
+#include "../include/session_recorder.h"
+
+static size_t utf8SequenceLength(unsigned char leadByte){
+    if(leadByte < 0xC0) return 1; //ascii, or a stray continuation byte passed through as is
+    if(leadByte < 0xE0) return 2;
+    if(leadByte < 0xF0) return 3;
+    if(leadByte < 0xF8) return 4;
+    return 1;
+}
+
+/*
+    JSON string contents. Strict asciicast parsers want valid UTF-8, so every
+    invalid or unfinished sequence is written as \ufffd, like the emulator
+    itself would show it.
+*/
+static void appendEscaped(std::string& output, const char* data, size_t length){
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    Utf8Decoder decoder;
+    size_t sequenceStart = 0;
+    for(size_t i = 0; i < length; i++){
+        unsigned char byte = data[i];
+        if(byte >= 0x80 || decoder.isPending()){
+            bool leadByte = !decoder.isPending();
+            if(leadByte)
+                sequenceStart = i;
+
+            char32_t codepoint;
+            Utf8Decoder::Result result = decoder.decode(byte, codepoint);
+            if(result == Utf8Decoder::REJECTED){
+                //the byte that broke the sequence may start the next one
+                output += "\\ufffd";
+                i--;
+            }else if(result == Utf8Decoder::COMPLETE){
+                //a bad lead byte decodes to U+FFFD on its own, an encoded U+FFFD is copied like any other character
+                if(leadByte && codepoint == Utf8Decoder::REPLACEMENT)
+                    output += "\\ufffd";
+                else
+                    output.append(data + sequenceStart, i + 1 - sequenceStart);
+            }
+            continue;
+        }
+
+        if(byte == '"' || byte == '\\'){
+            output += '\\';
+            output += static_cast<char>(byte);
+        }else if(byte == '\n'){
+            output += "\\n";
+        }else if(byte == '\r'){
+            output += "\\r";
+        }else if(byte == '\t'){
+            output += "\\t";
+        }else if(byte < 0x20 || byte == 0x7F){
+            output += "\\u00";
+            output += HEX_DIGITS[byte >> 4];
+            output += HEX_DIGITS[byte & 0x0F];
+        }else{
+            output += static_cast<char>(byte);
+        }
+    }
+
+    if(decoder.isPending())
+        output += "\\ufffd";
+}
+
+SessionRecorder::SessionRecorder()
+    : fd(-1),
+    startNS(0),
+    thread(nullptr),
+    mutex(nullptr),
+    condition(nullptr),
+    running(false),
+    carryLength(0)
+{}
+
+SessionRecorder::~SessionRecorder(){
+    stop();
+}
+
+bool SessionRecorder::start(const std::string& path, int columns, int rows){
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd == -1){
+        SDL_Log("Unable to open recording file: %s\n", path.c_str());
+        return false;
+    }
+
+    pending.reserve(FLUSH_THRESHOLD * 2);
+    writing.reserve(FLUSH_THRESHOLD * 2);
+
+    char header[128];
+    snprintf(header, sizeof(header), "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld}\n",
+            columns, rows, static_cast<long long>(time(nullptr)));
+    pending += header;
+
+    if(!(mutex = SDL_CreateMutex()) || !(condition = SDL_CreateCondition())){
+        SDL_Log("Unable to create recorder synchronization: %s\n", SDL_GetError());
+        return false;
+    }
+
+    startNS = SDL_GetTicksNS();
+    running = true;
+    if(!(thread = SDL_CreateThread(threadFunction, "session_recorder", this))){
+        SDL_Log("Unable to create recorder thread: %s\n", SDL_GetError());
+        running = false;
+        return false;
+    }
+
+    return true;
+}
+
+void SessionRecorder::stop(){
+    if(thread){
+        SDL_LockMutex(mutex);
+        //a sequence the shell never finished, written out as U+FFFD rather than dropped
+        if(carryLength > 0){
+            appendEvent('o', carry, carryLength);
+            carryLength = 0;
+        }
+        running = false;
+        SDL_SignalCondition(condition);
+        SDL_UnlockMutex(mutex);
+
+        SDL_WaitThread(thread, nullptr);
+        thread = nullptr;
+    }
+
+    SDL_DestroyCondition(condition);
+    condition = nullptr;
+    SDL_DestroyMutex(mutex);
+    mutex = nullptr;
+
+    if(fd != -1){
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool SessionRecorder::isRecording(){
+    return thread != nullptr;
+}
+
+void SessionRecorder::appendEvent(char type, const char* data, size_t length){
+    char prefix[48];
+    double seconds = (SDL_GetTicksNS() - startNS) / static_cast<double>(SDL_NS_PER_SECOND);
+    snprintf(prefix, sizeof(prefix), "[%.6f, \"%c\", \"", seconds, type);
+
+    pending += prefix;
+    appendEscaped(pending, data, length);
+    pending += "\"]\n";
+}
+
+void SessionRecorder::record(const char* data, size_t length){
+    if(!thread)
+        return;
+
+    //finish a sequence left over from the last read first
+    if(carryLength > 0){
+        size_t needed = utf8SequenceLength(carry[0]) - carryLength;
+        size_t taken = std::min(needed, length);
+        std::copy_n(data, taken, carry + carryLength);
+        carryLength += taken;
+        data += taken;
+        length -= taken;
+        if(taken < needed)
+            return;
+    }
+
+    //hold back a trailing sequence that the next read completes
+    size_t tailLength = 0;
+    for(size_t back = 1; back <= 3 && back <= length; back++){
+        unsigned char byte = data[length - back];
+        if(byte < 0x80)
+            break;
+        if(byte >= 0xC0){
+            if(utf8SequenceLength(byte) > back)
+                tailLength = back;
+            break;
+        }
+    }
+    length -= tailLength;
+
+    SDL_LockMutex(mutex);
+    if(carryLength > 0 && length > 0){
+        //one event, the completed sequence followed by the rest of this read
+        std::string joined(carry, carryLength);
+        joined.append(data, length);
+        appendEvent('o', joined.data(), joined.size());
+    }else if(carryLength > 0){
+        appendEvent('o', carry, carryLength);
+    }else if(length > 0){
+        appendEvent('o', data, length);
+    }
+    if(pending.size() >= FLUSH_THRESHOLD)
+        SDL_SignalCondition(condition);
+    SDL_UnlockMutex(mutex);
+
+    std::copy_n(data + length, tailLength, carry);
+    carryLength = tailLength;
+}
+
+void SessionRecorder::recordResize(int columns, int rows){
+    if(!thread)
+        return;
+
+    std::string size = std::to_string(columns) + "x" + std::to_string(rows);
+
+    SDL_LockMutex(mutex);
+    appendEvent('r', size.data(), size.size());
+    SDL_UnlockMutex(mutex);
+}
+
+int SessionRecorder::threadFunction(void* data){
+    static_cast<SessionRecorder*>(data)->writeLoop();
+    return 0;
+}
+
+void SessionRecorder::writeLoop(){
+    bool writeFailed = false;
+
+    SDL_LockMutex(mutex);
+    while(true){
+        if(running && pending.size() < FLUSH_THRESHOLD)
+            SDL_WaitConditionTimeout(condition, mutex, FLUSH_INTERVAL_MS);
+
+        bool stopping = !running;
+        writing.swap(pending);
+        SDL_UnlockMutex(mutex);
+
+        //the disk write happens without the lock so record() never waits on it
+        size_t written = 0;
+        while(!writeFailed && written < writing.size()){
+            ssize_t result = write(fd, writing.data() + written, writing.size() - written);
+            if(result > 0){
+                written += result;
+            }else if(errno != EINTR){
+                SDL_Log("Writing the session recording failed, the rest of the session is not recorded\n");
+                writeFailed = true;
+            }
+        }
+        writing.clear();
+
+        if(stopping)
+            return;
+        SDL_LockMutex(mutex);
+    }
+}
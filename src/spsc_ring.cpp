@@ -0,0 +1,65 @@
+#include "../include/spsc_ring.h"
+
+//stops at the largest power of two a size_t holds, shifting past it would wrap to 0 and never end
+static size_t roundUpToPowerOfTwo(size_t value){
+    size_t result = 1;
+    while(result < value && result <= SIZE_MAX / 2)
+        result <<= 1;
+    return result;
+}
+
+SpscRing::SpscRing(size_t capacity)
+    : buffer(roundUpToPowerOfTwo(capacity)),
+    mask(buffer.size() - 1),
+    head(0),
+    tail(0)
+{}
+
+void SpscRing::setCapacity(size_t capacity){
+    buffer.assign(roundUpToPowerOfTwo(capacity), 0);
+    mask = buffer.size() - 1;
+    head = 0;
+    tail = 0;
+}
+
+size_t SpscRing::getCapacity(){
+    return buffer.size();
+}
+
+size_t SpscRing::size(){
+    return head.load() - tail.load();
+}
+
+bool SpscRing::empty(){
+    return size() == 0;
+}
+
+bool SpscRing::full(){
+    return size() == buffer.size();
+}
+
+char* SpscRing::writableSpan(size_t& length){
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    size_t freeBytes = buffer.size() - (currentHead - tail.load());
+    size_t untilWrap = buffer.size() - (currentHead & mask);
+
+    length = freeBytes < untilWrap ? freeBytes : untilWrap;
+    return &buffer[currentHead & mask];
+}
+
+void SpscRing::commitWrite(size_t length){
+    head.store(head.load(std::memory_order_relaxed) + length);
+}
+
+const char* SpscRing::readableSpan(size_t& length){
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    size_t usedBytes = head.load() - currentTail;
+    size_t untilWrap = buffer.size() - (currentTail & mask);
+
+    length = usedBytes < untilWrap ? usedBytes : untilWrap;
+    return &buffer[currentTail & mask];
+}
+
+void SpscRing::commitRead(size_t length){
+    tail.store(tail.load(std::memory_order_relaxed) + length);
+}
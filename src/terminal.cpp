@@ -1,36 +1,86 @@
 #include "../include/terminal.h"
 
-Terminal::Terminal(SDL_Renderer* renderer)
-    : pixelWidth(0),
-    pixelHeight(0),
+Terminal::Terminal()
+    : columns(0),
+    rows(0),
     initialized(false),
-    renderTarget(nullptr),
-    renderer(renderer),
-    paddingX(0),
-    paddingY(0),
-    cursorColumn(0),
-    cursorRow(0),
-    ptyOutputState(NORMAL_TEXT),
-    currentCSISequence(""),
-    currentOSCSequence(""),
-    currentDCSSequence(""),
-    tabWidth(8),
+    terminalRenderer(nullptr),
     shell("sh"),
-    mediaPath(MEDIA_PATH)
+    mediaPath(MEDIA_PATH),
+    masterFD(-1),
+    slaveFD(-1),
+    childPID(-1),
+    childExited(false),
+    readBudgetBytes(1 << 20),
+    readBudgetNS(8 * SDL_NS_PER_MS),
+    totalBytesRead(0),
+    mirrorStdout(false),
+    inputQueueOffset(0),
+    frameStats{},
+    reportedTotals{},
+    replayFast(false),
+    replayResizeIndex(0),
+    sizeChanged(false),
+    maxFPS(60),
+    vsync(true),
+    floodLatencyNS(8 * SDL_NS_PER_MS)
 {}
 
 Terminal::~Terminal(){
-    SDL_DestroyTexture(renderTarget);
-    if(initialized){
+    ptyReader.stop();
+    player.stop();
+    recorder.stop();
+    //the shell is started before init(), which can still fail after it
+    if(childPID > 0){
         kill(childPID, SIGKILL);
         waitpid(childPID, nullptr, 0);
+    }
+    if(masterFD != -1)
         close(masterFD);
+    //a replay pipe's write end the player never took
+    if(slaveFD != -1)
+        close(slaveFD);
+}
+
+/*
+    Closes every fd from 3 up in the child before the shell runs, whatever
+    the emulator opened without close-on-exec (like the --perf-csv file) or
+    inherited from its own parent. Without closefrom the open fds are listed
+    from /proc and closed one by one.
+*/
+static void addCloseInheritedFDs(posix_spawn_file_actions_t* actions){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    posix_spawn_file_actions_addclosefrom_np(actions, 3);
+#else
+    DIR* fdDirectory = opendir("/proc/self/fd");
+    if(fdDirectory == nullptr){
+        //no /proc, close everything below the fd limit
+        long maxFD = std::min(sysconf(_SC_OPEN_MAX), 65536l);
+        for(int fd = 3; fd < maxFD; fd++)
+            posix_spawn_file_actions_addclose(actions, fd);
+        return;
     }
+
+    //the directory's own fd is listed too, it's closed before the spawn and closing it again in the child is harmless
+    while(dirent* entry = readdir(fdDirectory)){
+        int fd = atoi(entry->d_name);
+        if(fd >= 3)
+            posix_spawn_file_actions_addclose(actions, fd);
+    }
+    closedir(fdDirectory);
+#endif
 }
 
+/*
+    Opens the PTY and starts the shell on its slave side with posix_spawn,
+    which doesn't copy the page tables like fork does. The child becomes a
+    session leader first, so opening the slave there makes it the
+    controlling terminal. The parent never opens the slave and every other
+    fd is closed in the child, so the shell inherits nothing but its three
+    standard fds.
+*/
 bool Terminal::initPTY(){
-    //Get file descriptors
-    masterFD = posix_openpt(O_RDWR | O_NOCTTY);
+    masterFD = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
     if(masterFD == -1)
         return false;
     if(grantpt(masterFD) == -1)
@@ -42,124 +92,156 @@ bool Terminal::initPTY(){
     if(ptsname_r(masterFD, slaveName, 50) != 0)
         return false;
 
-    slaveFD = open(slaveName, O_RDWR);
-
-    //fork, child process replaces itself with the configured shell
+    //the shell reads its size while it starts up, before the window exists to resize it
+    struct winsize ws{};
+    ws.ws_col = columns;
+    ws.ws_row = rows;
+    ioctl(masterFD, TIOCSWINSZ, &ws);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attributes);
+
+    posix_spawn_file_actions_addopen(&actions, 0, slaveName, O_RDWR, 0);
+    posix_spawn_file_actions_adddup2(&actions, 0, 1);
+    posix_spawn_file_actions_adddup2(&actions, 0, 2);
+    addCloseInheritedFDs(&actions);
+
+    //a new session, with no signals blocked or ignored, whatever SDL set up for itself
+    sigset_t signals;
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+
+    char* argv[] = {const_cast<char*>(shell.c_str()), nullptr};
     pid_t pid;
-    pid = fork();
+    int result = posix_spawnp(&pid, shell.c_str(), &actions, &attributes, argv, environ);
 
-    if(pid == 0){
-        close(masterFD);
-        
-        //create new session group
-        setsid();
-
-        //make the terminal the controlling terminal for the session check for -1 error
-        ioctl(slaveFD, TIOCSCTTY, nullptr); 
-
-        //duplicate the slave file descriptor for stdin, stdout, and stderr
-        dup2(slaveFD, 0);
-        dup2(slaveFD, 1);
-        dup2(slaveFD, 2);
-
-        close(slaveFD);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
 
-        //execute shell and replace the current process
-        execlp(shell.c_str(), shell.c_str(), nullptr);
-    } else {
-        close(slaveFD);
-        childPID = pid;
-        //prevent blocking reads
-        fcntl(masterFD, F_SETFL, O_NONBLOCK);
+    if(result != 0){
+        SDL_Log("Could not start %s: %s\n", shell.c_str(), strerror(result));
+        return false;
     }
 
+    childPID = pid;
+    //prevent blocking reads
+    fcntl(masterFD, F_SETFL, O_NONBLOCK);
+
     return true;
 }
 
-bool Terminal::initFont(){
-    font.setFilepath(fontPath);
-    font.setRenderer(renderer);
-
-    if(!font.load())
+/*
+    A replay reads the recording from a pipe in place of the PTY master,
+    there is no child process and input goes nowhere.
+*/
+bool Terminal::initReplay(){
+    int pipeFDs[2];
+    if(pipe2(pipeFDs, O_NONBLOCK | O_CLOEXEC) == -1)
         return false;
 
+    masterFD = pipeFDs[0];
+    slaveFD = pipeFDs[1];
+    childPID = -1;
     return true;
 }
 
-void Terminal::setPixelDimensions(){
-    pixelWidth = columns * (font.getWidth() + paddingX);
-    pixelHeight = rows * (font.getHeight() + paddingY);
-}
-
 bool Terminal::updateDimensions(int newWidth, int newHeight){
-    pixelWidth = newWidth;
-    pixelHeight = newHeight;
+    if(!terminalRenderer.resize(newWidth, newHeight))
+        return false;
 
-    columns = (pixelWidth + paddingX) / (font.getWidth() + paddingX);
-    rows = (pixelHeight + paddingY) / (font.getHeight() + paddingY);
+    columns = terminalRenderer.columnsForWidth(newWidth);
+    rows = terminalRenderer.rowsForHeight(newHeight);
+
+    //most pixel size changes while dragging don't add or remove a whole cell, nothing else needs to know about those
+    if(columns == model.getColumns() && rows == model.getRows())
+        return true;
+
+    model.resize(columns, rows);
 
     SDL_Log("New column size: %i\n", columns);
     SDL_Log("New row size: %i\n", rows);
 
-    //TODO could break if not initialized but needs to be called from init method
-    //change the size of the pty
-    struct winsize ws;
-    ws.ws_col = columns;
-    ws.ws_row = rows;
-    if(ioctl(masterFD, TIOCSWINSZ, &ws) == -1)
-        return false;
+    recorder.recordResize(columns, rows);
 
-    //let the application running in the terminal know there was a change
-    if(kill(childPID, SIGWINCH) == -1)
-        return false;
+    //a replay has no PTY or child to tell about the new size
+    if(childPID > 0){
+        //TODO could break if not initialized but needs to be called from init method
+        //change the size of the pty
+        struct winsize ws;
+        ws.ws_col = columns;
+        ws.ws_row = rows;
+        if(ioctl(masterFD, TIOCSWINSZ, &ws) == -1)
+            return false;
 
-    //update render target texture
-    if(!(renderTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_TARGET, pixelWidth, pixelHeight))){
-        SDL_Log("Unable to update render target texture: %s\n", SDL_GetError());
-        return false;
+        //let the application running in the terminal know there was a change
+        if(kill(childPID, SIGWINCH) == -1)
+            return false;
     }
-   
+
     return true;
 }
 
 void Terminal::setPadding(unsigned int x, unsigned int y){
-    paddingX = x;
-    paddingY = y;
-    
+    terminalRenderer.setPadding(x, y);
+
     if(initialized)
-        updateDimensions(pixelWidth, pixelHeight);
+        updateDimensions(terminalRenderer.getPixelWidth(), terminalRenderer.getPixelHeight());
 }
 
-bool Terminal::init(std::string shell){
+void Terminal::setRecordPath(const std::string& path){
+    recordPath = path;
+}
+
+void Terminal::setReplay(const std::string& path, bool fast){
+    replayPath = path;
+    replayFast = fast;
+}
+
+bool Terminal::start(){
     if(!loadConfig()){
         SDL_Log("Could not load config!\n");
         return false;
     }
 
-    if(!initFont()){
-        SDL_Log("Could not initialize font!\n");
+    //the recording's size wins over the configured one so the output lays out the same
+    if(!replayPath.empty()){
+        if(!player.load(replayPath)){
+            SDL_Log("Could not load recording!\n");
+            return false;
+        }
+        columns = player.getColumns();
+        rows = player.getRows();
+    }
+
+    if(replayPath.empty() ? !initPTY() : !initReplay()){
+        SDL_Log("Could not initialize PTY!\n");
         return false;
     }
 
-    setPixelDimensions();
+    return true;
+}
 
-    if(!(renderTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_TARGET, pixelWidth, pixelHeight))){
-        SDL_Log("Unable to create render target texture: %s\n", SDL_GetError());
+bool Terminal::init(SDL_Renderer* renderer){
+    terminalRenderer.setRenderer(renderer);
+    if(!terminalRenderer.loadFont(fontPath)){
+        SDL_Log("Could not initialize font!\n");
         return false;
     }
 
-    if(!SDL_SetTextureScaleMode(renderTarget, SDL_SCALEMODE_NEAREST)){
-        SDL_Log("Could not set texture scale mode to SDL_SCALEMODE_NEAREST: %s\n", SDL_GetError());
+    if(!terminalRenderer.resize(columns * terminalRenderer.getCellWidth(), rows * terminalRenderer.getCellHeight()))
         return false;
-    }
 
-    if(!initPTY()){
-        SDL_Log("Could not initialize PTY!\n");
+    if(!recordPath.empty() && !recorder.start(recordPath, columns, rows)){
+        SDL_Log("Could not start recording!\n");
         return false;
     }
 
-    Line initialLine = {0, ""};
-    lines.push_back(initialLine);
+    model.resize(columns, rows);
 
     initialized = true;
     return true;
@@ -171,168 +253,261 @@ bool Terminal::render(int x, int y){
         return false;
     }
 
-    if(!SDL_SetRenderTarget(renderer, renderTarget)){
-        SDL_Log("Error setting render target to texture: %s\n", SDL_GetError());
+    return terminalRenderer.render(model, x, y, !holdingFrame());
+}
+
+bool Terminal::drawOverlay(const std::vector<std::string>& lines, int x, int y){
+    if(!initialized)
         return false;
-    }
 
-    drawLines(); 
+    return terminalRenderer.drawOverlay(lines, x, y);
+}
 
-    if(!SDL_SetRenderTarget(renderer, nullptr)){
-        SDL_Log("Error setting render target back to the window: %s\n", SDL_GetError());
-        return false;
-    }
-    
-    SDL_FRect destinationRect = {static_cast<float>(x),static_cast<float>(y), static_cast<float>(pixelWidth), static_cast<float>(pixelHeight)};
-    if(!SDL_RenderTexture(renderer, renderTarget, nullptr, &destinationRect)){
-        SDL_Log("Error rendering terminal texture to window: %s\n", SDL_GetError());
+bool Terminal::needsRender(){
+    if(!initialized || holdingFrame())
         return false;
-    }
 
-    return true;
+    return terminalRenderer.needsRender(model);
 }
 
-void Terminal::update(){
-    const int BUFF_SIZE = 256;
-    char buffer[BUFF_SIZE];
-    ssize_t bytesRead = read(masterFD, buffer, sizeof(buffer));
-    if (bytesRead > 0){
-        write(STDOUT_FILENO, buffer, bytesRead);
-        for(int i = 0; i < bytesRead; i++){
-            /* sequence handling specifically must come before checking for '\e' 
-             * this is due to OSI and DCS codes potentially being terminated with 0x1B 0x5C.
-             */
-            if(ptyOutputState == CSI_SEQUENCE){
-                addToCSISequence(buffer[i]);
-            }else if(ptyOutputState == OSC_SEQUENCE){
-                addToOSCSequence(buffer[i]);
-            }else if(ptyOutputState == DCS_SEQUENCE){
-                addToDCSSequence(buffer[i]);           
-            }else if(buffer[i] == '\e'){
-                ptyOutputState = ESCAPE_START;
-            }else if(ptyOutputState == ESCAPE_START){
-                // determine what kind of escape sequence it is
-                if(buffer[i] == '['){
-                    ptyOutputState = CSI_SEQUENCE;
-                }else if(buffer[i] == ']'){
-                    ptyOutputState = OSC_SEQUENCE;
-                }else if(buffer[i] == 'P'){
-                    ptyOutputState = DCS_SEQUENCE;
-                }else{ //single character sequence
-                    handleSingleCharacterSequence(buffer[i]);
-                    ptyOutputState = NORMAL_TEXT;
-                }
-
-            }else if(ptyOutputState == NORMAL_TEXT){
-                if(buffer[i] < 32 || buffer[i] > 126){
-                    handleAsciiCode(buffer[i]);
-                }else{
-                    lines.back().text.push_back(buffer[i]);
-                }
-            }
+//true while the application is in a synchronized update, so the last complete frame stays up
+bool Terminal::holdingFrame(){
+    return model.holdingFrame(SDL_GetTicksNS());
+}
+
+Uint64 Terminal::getSynchronizedDeadlineNS(){
+    return model.getSynchronizedDeadlineNS();
+}
+
+void Terminal::invalidate(){
+    terminalRenderer.invalidate();
+}
 
-            /*if(buffer[i] == '\n' || buffer[i] == '\r'){ //newline
-                lineIndex++;
-                if(lineIndex >= maxLines)
-                    lineIndex = 0;
-            }else if(buffer[i] == '\b'){ //backspace
-                lines[lineIndex].pop_back();
-            }else{ // append output to line
-                lines[lineIndex] += buffer[i];
-            }*/
+/*
+    Consumes output the reader thread has buffered, until the ring is empty or
+    the per call budget runs out.
+    Returns true when the budget ran out with output still pending.
+*/
+bool Terminal::update(){
+    //acknowledge before draining so output that arrives meanwhile posts a new event
+    ptyReader.acknowledge();
+
+    Uint64 startNS = SDL_GetTicksNS();
+    size_t bytesThisCall = 0;
+    bool outputPending = false;
+
+    while(true){
+        applyReplayResizes();
+
+        size_t length;
+        const char* data = outputRing.readableSpan(length);
+        if(length == 0)
+            break;
+
+        //parse in bounded chunks so the time budget is checked regularly
+        length = std::min(length, std::min(PARSE_CHUNK_SIZE, readBudgetBytes - bytesThisCall));
+        //and never past a recorded resize, the output after it was written for the new size
+        const std::vector<SessionPlayer::Resize>& resizes = player.getResizes();
+        if(replayResizeIndex < resizes.size())
+            length = std::min(length, static_cast<size_t>(resizes[replayResizeIndex].outputOffset - totalBytesRead));
+
+        if(mirrorStdout)
+            write(STDOUT_FILENO, data, length);
+        model.processOutput(data, length);
+
+        outputRing.commitRead(length);
+        ptyReader.spaceAvailable();
+
+        bytesThisCall += length;
+        totalBytesRead += length;
+
+        if(bytesThisCall >= readBudgetBytes || SDL_GetTicksNS() - startNS >= readBudgetNS){
+            outputPending = !outputRing.empty();
+            break;
         }
     }
+
+    applyReplayResizes();
+    sendReplies();
+    //start the timeout from when the update began, not from when something first asks to render
+    holdingFrame();
+
+    frameStats.bytesParsed += bytesThisCall;
+    frameStats.parseNS += SDL_GetTicksNS() - startNS;
+
+    if(!outputPending && ptyReader.hasExited() && outputRing.empty())
+        childExited = true;
+
+    return outputPending;
 }
 
-void Terminal::handleAsciiCode(char character){
-    if(character == '\r'){
-        int row = lines.back().row;
-        row += lines.back().text.length() / columns;
-        if(lines.back().text.length() % columns)
-            row++;
-        Line newline = {row, ""};
-        lines.push_back(newline);
+//recorded resizes whose preceding output has all been parsed, in the order they happened
+void Terminal::applyReplayResizes(){
+    const std::vector<SessionPlayer::Resize>& resizes = player.getResizes();
+    while(replayResizeIndex < resizes.size() && resizes[replayResizeIndex].outputOffset <= totalBytesRead){
+        const SessionPlayer::Resize& resize = resizes[replayResizeIndex++];
+        //the pixel size that holds exactly this many cells, the same path a window resize takes
+        if(updateDimensions(resize.columns * terminalRenderer.getCellWidth(), resize.rows * terminalRenderer.getCellHeight()))
+            sizeChanged = true;
     }
 }
 
-void Terminal::handleSingleCharacterSequence(char command){
-    ptyOutputState = NORMAL_TEXT;
+bool Terminal::takeSizeChange(){
+    bool changed = sizeChanged;
+    sizeChanged = false;
+    return changed;
 }
 
-static std::vector<unsigned int> parseParameters(const std::string& input) {
-    std::vector<unsigned int> parameters;
-    std::istringstream inputStream(input);
-    std::string token;
+bool Terminal::startReader(Uint32 eventType){
+    if(!initialized){
+        SDL_Log("Call to Terminal::startReader before terminal is initialized!\n");
+        return false;
+    }
 
-    while (std::getline(inputStream, token, ';')) {
-        if (token.empty()) {
-            parameters.push_back(0); // Default value for empty parameters
-        } else {
-            try {
-                parameters.push_back(std::stoi(token));
-            } catch (const std::invalid_argument&) {
-                parameters.push_back(0); // Invalid -> Default to 0
-            } catch (const std::out_of_range&) {
-                parameters.push_back(0); // Out of range -> Default to 0
-            }
-        }
+    if(recorder.isRecording())
+        ptyReader.setRecorder(&recorder);
+
+    if(!ptyReader.start(masterFD, &outputRing, eventType))
+        return false;
+
+    //the player owns the pipe's write end from here on
+    if(!replayPath.empty()){
+        if(!player.start(slaveFD, replayFast))
+            return false;
+        slaveFD = -1;
     }
 
-    if(!input.empty() && input.back() == ';')
-        parameters.push_back(0);
+    return true;
+}
 
-    return parameters;
+FrameStats Terminal::takeFrameStats(){
+    //these are running totals kept elsewhere, report what changed since the last call
+    FrameStats totals{};
+    totals.bytesRead = ptyReader.getBytesRead();
+    totals.escapeSequences = model.getEscapeSequenceCount();
+    totals.cellsDrawn = terminalRenderer.getCellsDrawnCount();
+    totals.drawCalls = terminalRenderer.getDrawCallCount();
+
+    FrameStats stats = frameStats;
+    stats.bytesRead = totals.bytesRead - reportedTotals.bytesRead;
+    stats.escapeSequences = totals.escapeSequences - reportedTotals.escapeSequences;
+    stats.cellsDrawn = totals.cellsDrawn - reportedTotals.cellsDrawn;
+    stats.drawCalls = totals.drawCalls - reportedTotals.drawCalls;
+
+    reportedTotals = totals;
+    frameStats = FrameStats{};
+    return stats;
 }
 
-void Terminal::addToCSISequence(char character){
-    if(character >= '@' && character <= '~'){
-        if(!currentCSISequence.empty()){
-            if(currentCSISequence[0] >= '0' && currentCSISequence[0] <= '9'){
-                std::vector<unsigned int> parameters = parseParameters(currentCSISequence);
-                handleCSISequence(parameters, character);
-            }else if(currentCSISequence[0] == '?'){ // TODO ignored for now
-                // handle private modes
-            }else if(currentCSISequence[0] == '='){
-                // handle set mode sequences
-            }
-        }
-        ptyOutputState = NORMAL_TEXT;
-        currentCSISequence = "";
-    }else{
-        currentCSISequence += character;
-    }
+uint64_t Terminal::getBytesRead(){
+    return totalBytesRead;
 }
 
-void Terminal::handleCSISequence(std::vector<unsigned int> args, char command){
-    return;
+void Terminal::scrollView(int lines){
+    model.scrollView(lines);
 }
 
-void Terminal::addToOSCSequence(char character){
-    if((character == '\\' && !currentOSCSequence.empty() && currentOSCSequence.back() == '\e') || character == '\a'){
-        // TODO impliment
-        ptyOutputState = NORMAL_TEXT;
-        currentOSCSequence = "";
-    }else{
-        currentOSCSequence += character;
-    }
+void Terminal::scrollViewPages(int pages){
+    model.scrollView(pages * rows);
 }
 
-void Terminal::addToDCSSequence(char character){
-    if(character == '\\' && !currentOSCSequence.empty() && currentOSCSequence.back() == '\e'){
-        // TODO impliment
-        ptyOutputState = NORMAL_TEXT;
-        currentOSCSequence = "";
-    }else{
-        currentDCSSequence += character;
-    }
+void Terminal::scrollViewToBottom(){
+    model.scrollViewToBottom();
+}
+
+//answers to queries the output made, they go out after any input already queued
+void Terminal::sendReplies(){
+    const std::string& replies = model.getReplies();
+    if(replies.empty())
+        return;
+
+    queueInput(replies.c_str(), replies.length());
+    model.clearReplies();
+}
+
+//a replay has no child to send input to
+void Terminal::queueInput(const char* data, size_t length){
+    if(childPID <= 0)
+        return;
+    inputQueue.append(data, length);
 }
 
 void Terminal::sendChar(char character){
-    write(masterFD, &character, 1);
+    scrollViewToBottom();
+    queueInput(&character, 1);
 }
 
 void Terminal::sendSequence(const std::string& sequence){
-    write(masterFD, sequence.c_str(), sequence.length());
+    //modifier keys on their own map to an empty sequence and shouldn't move the view
+    if(sequence.empty())
+        return;
+
+    scrollViewToBottom();
+    queueInput(sequence.c_str(), sequence.length());
+}
+
+/*
+    Line breaks are sent as carriage returns, like the Enter key. In a bracketed
+    paste escapes are dropped so the text can't end the paste early and pose as typed input.
+    The whole paste is queued at once, flushInput() feeds it to the PTY as fast as it's read.
+*/
+void Terminal::paste(const std::string& text){
+    if(text.empty())
+        return;
+
+    scrollViewToBottom();
+    if(childPID <= 0)
+        return;
+
+    bool bracketed = model.isBracketedPaste();
+    inputQueue.reserve(inputQueue.size() + text.size() + 12);
+    if(bracketed)
+        inputQueue += "\e[200~";
+    for(size_t i = 0; i < text.size(); i++){
+        char character = text[i];
+        if(character == '\n'){
+            if(i > 0 && text[i - 1] == '\r')
+                continue;
+            character = '\r';
+        }else if(character == '\e' && bracketed){
+            continue;
+        }
+        inputQueue.push_back(character);
+    }
+    if(bracketed)
+        inputQueue += "\e[201~";
+}
+
+/*
+    The master is non-blocking, so a write takes what fits in the PTY's buffer and
+    EAGAIN means it's full. The rest stays queued and the reader thread posts an
+    event once the child has read enough for the PTY to be writable again.
+    Returns false when the PTY can't be written at all anymore.
+*/
+bool Terminal::flushInput(){
+    while(inputQueueOffset < inputQueue.size()){
+        ssize_t written = write(masterFD, inputQueue.data() + inputQueueOffset, inputQueue.size() - inputQueueOffset);
+        if(written > 0){
+            inputQueueOffset += written;
+        }else if(written == -1 && errno == EAGAIN){
+            ptyReader.watchWritable();
+            return true;
+        }else if(written == -1 && errno != EINTR){
+            //the child is gone, nobody will read the rest
+            SDL_Log("Unable to write input to the PTY: %s\n", strerror(errno));
+            inputQueue.clear();
+            inputQueueOffset = 0;
+            return false;
+        }
+    }
+
+    //a big paste shouldn't keep its buffer for the rest of the session
+    const size_t KEPT_CAPACITY = 64 * 1024;
+    if(inputQueue.capacity() > KEPT_CAPACITY)
+        std::string().swap(inputQueue);
+    inputQueue.clear();
+    inputQueueOffset = 0;
+    return true;
 }
 
 bool Terminal::loadParametersFromFile(std::string filepath, std::unordered_map<std::string, std::string> &parameters){
@@ -389,6 +564,16 @@ static int safeStoi(const std::string& string, int base, int defaultValue = 0){
     }
 }
 
+//for settings where a value out of range would break something, reports it and uses the nearest allowed one
+static int clampSetting(const char* name, int value, int minimum, int maximum){
+    if(value >= minimum && value <= maximum)
+        return value;
+
+    int clamped = std::max(minimum, std::min(value, maximum));
+    SDL_Log("%s must be between %d and %d, %d is used instead of %d\n", name, minimum, maximum, clamped, value);
+    return clamped;
+}
+
 bool Terminal::loadConfig(){
     std::unordered_map<std::string, std::string> parameters;
     std::string defaultConfigFilepath = mediaPath + "defaults.conf";
@@ -408,7 +593,8 @@ bool Terminal::loadConfig(){
     else
         fontPath = mediaPath + "fonts/tom-thumb.bdf";
 
-    //load theme
+    //load theme, colors it leaves out keep xterm's
+    std::copy(DEFAULT_THEME, DEFAULT_THEME + 16, theme);
     std::unordered_map<std::string, std::string> colors;
     if (parameters.find("theme") != parameters.end()){
         std::string themePath = mediaPath + "themes/" + parameters["theme"];
@@ -423,11 +609,19 @@ bool Terminal::loadConfig(){
         }
     }
 
-    //set maxScrollbackLines
-    if (parameters.find("max_lines") != parameters.end())
-        maxScrollbackLines = safeStoi(parameters["scrollback_lines"], 10, 256);
+    //the colors of text without SGR colors, separate from the palette
+    int foreground = theme[7];
+    int background = theme[0];
+    if (colors.find("foreground") != colors.end())
+        foreground = safeStoi(colors["foreground"], 16, foreground);
+    if (colors.find("background") != colors.end())
+        background = safeStoi(colors["background"], 16, background);
+    terminalRenderer.setTheme(theme, foreground, background);
+
+    if (parameters.find("scrollback_lines") != parameters.end())
+        model.setScrollbackLines(safeStoi(parameters["scrollback_lines"], 10, 1024));
     else
-        maxScrollbackLines = 256;
+        model.setScrollbackLines(1024);
 
     //set columns and rows
     if (parameters.find("columns") != parameters.end())
@@ -440,10 +634,67 @@ bool Terminal::loadConfig(){
     else
         rows = 10;
     
+    //batch_rendering: false falls back to one draw call per glyph, useful for comparing the two paths
+    if (parameters.find("batch_rendering") != parameters.end())
+        terminalRenderer.setBatchRendering(parameters["batch_rendering"] != "false");
+    else
+        terminalRenderer.setBatchRendering(true);
+
     if (parameters.find("tab_width") != parameters.end())
-        tabWidth = safeStoi(parameters["tab_width"], 10, 8);
+        model.setTabWidth(safeStoi(parameters["tab_width"], 10, 8));
+    else
+        model.setTabWidth(8);
+
+    //limits on how much PTY output one update() may consume, so input stays responsive during floods
+    if (parameters.find("read_budget_bytes") != parameters.end())
+        readBudgetBytes = clampSetting("read_budget_bytes", safeStoi(parameters["read_budget_bytes"], 10, 1 << 20), 4096, 1 << 30);
+    else
+        readBudgetBytes = 1 << 20;
+
+    if (parameters.find("read_budget_ms") != parameters.end())
+        readBudgetNS = clampSetting("read_budget_ms", safeStoi(parameters["read_budget_ms"], 10, 8), 1, 1000) * SDL_NS_PER_MS;
+    else
+        readBudgetNS = 8 * SDL_NS_PER_MS;
+
+    //bytes the reader thread may buffer ahead of the parser before it stops reading
+    if (parameters.find("output_buffer_size") != parameters.end())
+        outputRing.setCapacity(clampSetting("output_buffer_size", safeStoi(parameters["output_buffer_size"], 10, 1 << 22), 1 << 16, 1 << 30));
+    else
+        outputRing.setCapacity(1 << 22);
+
+    //treat bytes 0x80 to 0x9F as C1 controls instead of text, off by default since it breaks UTF-8
+    if (parameters.find("eight_bit_controls") != parameters.end())
+        model.setEightBitControls(parameters["eight_bit_controls"] == "true");
+    else
+        model.setEightBitControls(false);
+
+    if (parameters.find("mirror_stdout") != parameters.end())
+        mirrorStdout = parameters["mirror_stdout"] == "true";
     else
-        tabWidth = 8;
+        mirrorStdout = false;
+
+    if (parameters.find("max_fps") != parameters.end())
+        maxFPS = safeStoi(parameters["max_fps"], 10, 60);
+    else
+        maxFPS = 60;
+
+    //how far past its time a frame may be held back while a flood of output is still being parsed
+    if (parameters.find("flood_latency_ms") != parameters.end())
+        floodLatencyNS = std::max(0, safeStoi(parameters["flood_latency_ms"], 10, 8)) * SDL_NS_PER_MS;
+    else
+        floodLatencyNS = 8 * SDL_NS_PER_MS;
+
+    //how long a synchronized update (mode 2026) may hold back frames before it's ended by force
+    if (parameters.find("sync_timeout_ms") != parameters.end())
+        model.setSynchronizedTimeout(clampSetting("sync_timeout_ms", safeStoi(parameters["sync_timeout_ms"], 10, 150),
+            TerminalModel::MIN_SYNC_TIMEOUT_MS, TerminalModel::MAX_SYNC_TIMEOUT_MS));
+    else
+        model.setSynchronizedTimeout(150);
+
+    if (parameters.find("vsync") != parameters.end())
+        vsync = parameters["vsync"] != "false";
+    else
+        vsync = true;
 
     // TODO add check for user config file in ~/.config/tiny-term
     return true;
@@ -451,34 +702,30 @@ bool Terminal::loadConfig(){
 
 int Terminal::getPixelWidth(){
     if(initialized)
-        return pixelWidth;
+        return terminalRenderer.getPixelWidth();
     else
         return -1;
 }
 
 int Terminal::getPixelHeight(){
     if(initialized)
-        return pixelHeight;
+        return terminalRenderer.getPixelHeight();
     else
         return -1;
 }
 
-bool Terminal::drawCharacter(int column, int row, char character){
-    if(column >= columns || row >= rows)
-        return false;
+bool Terminal::isRunning(){
+    return initialized && !childExited;
+}
 
-    font.render(column * (font.getWidth() + paddingX), row * (font.getHeight() + paddingY), character);
-    return true;
+int Terminal::getMaxFPS(){
+    return maxFPS;
 }
 
-void Terminal::drawLines(){
-    for(Line line : lines){
-        if(!line.text.empty()){
-            for(int i = 0; i < line.text.length(); i++){
-                int characterRow = line.row + (i / columns);
-                int characterColumn = i % columns;
-                drawCharacter(characterColumn, characterRow, line.text[i]);
-            }
-        }
-    }
+bool Terminal::getVsync(){
+    return vsync;
+}
+
+Uint64 Terminal::getFloodLatencyNS(){
+    return floodLatencyNS;
 }
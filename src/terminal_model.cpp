@@ -0,0 +1,631 @@
+#include "../include/terminal_model.h"
+
+TerminalModel::TerminalModel()
+    : columns(0),
+    rows(0),
+    viewOffset(0),
+    grid(&primaryGrid),
+    cursorColumn(0),
+    cursorRow(0),
+    wrapPending(false),
+    scrollTop(0),
+    scrollBottom(0),
+    pen(Grid::blankCell()),
+    savedCursor{0, 0, Grid::blankCell(), false},
+    synchronizedOutput(false),
+    synchronizedSinceNS(0),
+    synchronizedTimeoutNS(150 * 1000000ull),
+    bracketedPaste(false),
+    tabWidth(8),
+    parser(this),
+    escapeSequenceCount(0)
+{}
+
+void TerminalModel::setScrollbackLines(int lines){
+    primaryGrid.setScrollbackCapacity(lines);
+}
+
+void TerminalModel::setTabWidth(int width){
+    tabWidth = width < 1 ? 1 : width;
+}
+
+void TerminalModel::setEightBitControls(bool enabled){
+    parser.setEightBitControls(enabled);
+}
+
+void TerminalModel::resize(int newColumns, int newRows){
+    columns = newColumns < 1 ? 1 : newColumns;
+    rows = newRows < 1 ? 1 : newRows;
+
+    //on the alternate screen the saved cursor is the primary screen's, it moves along with its text
+    if(grid == &alternateGrid){
+        primaryGrid.resize(columns, rows, savedCursor.column, savedCursor.row);
+        alternateGrid.resize(columns, rows, cursorColumn, cursorRow);
+    }else{
+        primaryGrid.resize(columns, rows, cursorColumn, cursorRow);
+        int alternateColumn = 0, alternateRow = 0;
+        alternateGrid.resize(columns, rows, alternateColumn, alternateRow);
+    }
+    savedCursor.column = std::min(savedCursor.column, columns - 1);
+    savedCursor.row = std::min(savedCursor.row, rows - 1);
+    grid->ensureHistory(viewOffset);
+    viewOffset = std::min(viewOffset, grid->getHistorySize());
+    wrapPending = false;
+    //like xterm, a resize resets the scroll region to the whole screen
+    scrollTop = 0;
+    scrollBottom = rows - 1;
+}
+
+void TerminalModel::processOutput(const char* buffer, size_t length){
+    parser.parse(buffer, length);
+}
+
+void TerminalModel::handleAsciiCode(char character){
+    if(character == '\r'){
+        cursorColumn = 0;
+        wrapPending = false;
+    }else if(character == '\n' || character == '\v' || character == '\f'){
+        lineFeed();
+    }else if(character == '\b'){
+        if(cursorColumn > 0)
+            cursorColumn--;
+        wrapPending = false;
+    }else if(character == '\t'){
+        cursorColumn = std::min((cursorColumn / tabWidth + 1) * tabWidth, columns - 1);
+        wrapPending = false;
+    }
+}
+
+void TerminalModel::putRun(const char* characters, size_t length){
+    while(length > 0){
+        if(wrapPending)
+            wrapLine();
+
+        size_t count = std::min(length, static_cast<size_t>(columns - cursorColumn));
+        Cell* row = grid->getRow(cursorRow);
+        splitWideCharacters(row, cursorColumn, cursorColumn + count);
+        Cell* cells = row + cursorColumn;
+        for(size_t i = 0; i < count; i++){
+            cells[i] = pen;
+            cells[i].codepoint = static_cast<unsigned char>(characters[i]);
+        }
+        grid->markDirty(cursorRow);
+
+        cursorColumn += count;
+        if(cursorColumn == columns){
+            cursorColumn = columns - 1;
+            wrapPending = true;
+        }
+
+        characters += count;
+        length -= count;
+    }
+}
+
+void TerminalModel::putCodepoint(char32_t codepoint){
+    //C1 controls sent as UTF-8 have nothing to draw
+    if(codepoint < 0xA0)
+        return;
+
+    int width = characterWidth(codepoint);
+    if(width == 0){
+        addCombining(codepoint);
+        return;
+    }
+    if(width > columns)
+        return;
+
+    if(wrapPending)
+        wrapLine();
+    //a wide character doesn't get split over two lines, it moves to the next one
+    if(cursorColumn + width > columns)
+        wrapLine();
+
+    Cell* cells = grid->getRow(cursorRow);
+    splitWideCharacters(cells, cursorColumn, cursorColumn + width);
+    cells[cursorColumn] = pen;
+    cells[cursorColumn].codepoint = codepoint;
+    if(width == 2){
+        cells[cursorColumn + 1] = pen;
+        cells[cursorColumn + 1].flags = CELL_WIDE_CONTINUATION;
+    }
+    grid->markDirty(cursorRow);
+
+    cursorColumn += width;
+    if(cursorColumn == columns){
+        cursorColumn = columns - 1;
+        wrapPending = true;
+    }
+}
+
+//a zero width mark belongs to the character written before it
+void TerminalModel::addCombining(char32_t mark){
+    int column = wrapPending ? cursorColumn : cursorColumn - 1;
+    if(column < 0)
+        return;
+
+    if(column > 0 && (grid->getRow(cursorRow)[column].flags & CELL_WIDE_CONTINUATION))
+        column--;
+    grid->addCombining(column, cursorRow, mark);
+}
+
+//when cells first to end are about to be overwritten, blanks wide characters they would cut in half
+void TerminalModel::splitWideCharacters(Cell* cells, int first, int end){
+    if(first > 0 && (cells[first].flags & CELL_WIDE_CONTINUATION))
+        cells[first - 1] = Grid::blankCell();
+    if(end < columns && (cells[end].flags & CELL_WIDE_CONTINUATION))
+        cells[end] = Grid::blankCell();
+}
+
+//clamped to the screen, any cursor movement cancels a pending wrap
+void TerminalModel::moveCursor(int column, int row){
+    cursorColumn = std::max(0, std::min(column, columns - 1));
+    cursorRow = std::max(0, std::min(row, rows - 1));
+    wrapPending = false;
+}
+
+//blanks cells first to end of a screen row in the pen's background, like xterm does
+void TerminalModel::eraseCells(int row, int first, int end){
+    Cell erased = Grid::blankCell();
+    erased.background = pen.background;
+    erased.attributes = pen.attributes & ATTR_BACKGROUND;
+
+    Cell* cells = grid->getRow(row);
+    splitWideCharacters(cells, first, end);
+    std::fill(cells + first, cells + end, erased);
+    //a line cut short no longer runs on into the next one
+    if(end == columns)
+        grid->setWrapped(row, false);
+    grid->markDirty(row);
+}
+
+void TerminalModel::wrapLine(){
+    grid->setWrapped(cursorRow, true);
+    cursorColumn = 0;
+    lineFeed();
+}
+
+bool TerminalModel::isFullScreenRegion(){
+    return scrollTop == 0 && scrollBottom == rows - 1;
+}
+
+void TerminalModel::lineFeed(){
+    wrapPending = false;
+    if(cursorRow == scrollBottom){
+        //only a line leaving the whole screen goes into the history
+        if(isFullScreenRegion()){
+            grid->scrollUp();
+            //keep a scrolled back view on the same lines while output continues below it
+            if(viewOffset > 0)
+                viewOffset = std::min(viewOffset + 1, grid->getHistorySize());
+        }else{
+            grid->scrollRegionUp(scrollTop, scrollBottom, 1);
+        }
+    }else if(cursorRow < rows - 1){
+        cursorRow++;
+    }
+}
+
+void TerminalModel::reverseIndex(){
+    wrapPending = false;
+    if(cursorRow == scrollTop)
+        grid->scrollRegionDown(scrollTop, scrollBottom, 1);
+    else if(cursorRow > 0)
+        cursorRow--;
+}
+
+void TerminalModel::scrollView(int lines){
+    //history from before a resize is only rewrapped once it's scrolled to
+    grid->ensureHistory(viewOffset + lines);
+    int newOffset = std::max(0, std::min(viewOffset + lines, grid->getHistorySize()));
+    if(newOffset != viewOffset){
+        viewOffset = newOffset;
+        grid->markAllDirty();
+    }
+}
+
+void TerminalModel::scrollViewToBottom(){
+    scrollView(-viewOffset);
+}
+
+void TerminalModel::handleSingleCharacterSequence(char command){
+    if(command == 'D'){ //IND
+        lineFeed();
+    }else if(command == 'E'){ //NEL
+        cursorColumn = 0;
+        lineFeed();
+    }else if(command == 'M'){ //RI
+        reverseIndex();
+    }else if(command == '7'){ //DECSC
+        saveCursor();
+    }else if(command == '8'){ //DECRC
+        restoreCursor();
+    }
+}
+
+void TerminalModel::handleCSISequence(const CsiParameters& args, char command){
+    if(command == 'm'){
+        selectGraphicRendition(args);
+    }else if(command == 'H' || command == 'f'){ //CUP and HVP
+        moveCursor(args.get(1, 1) - 1, args.get(0, 1) - 1);
+    }else if(command == 'A'){ //CUU, stops at the top margin when it starts below it
+        int limit = cursorRow >= scrollTop ? scrollTop : 0;
+        moveCursor(cursorColumn, std::max(cursorRow - static_cast<int>(args.get(0, 1)), limit));
+    }else if(command == 'B'){ //CUD, stops at the bottom margin when it starts above it
+        int limit = cursorRow <= scrollBottom ? scrollBottom : rows - 1;
+        moveCursor(cursorColumn, std::min(cursorRow + static_cast<int>(args.get(0, 1)), limit));
+    }else if(command == 'C'){ //CUF
+        moveCursor(cursorColumn + args.get(0, 1), cursorRow);
+    }else if(command == 'D'){ //CUB
+        moveCursor(cursorColumn - static_cast<int>(args.get(0, 1)), cursorRow);
+    }else if(command == 'G'){ //CHA
+        moveCursor(args.get(0, 1) - 1, cursorRow);
+    }else if(command == 'd'){ //VPA
+        moveCursor(cursorColumn, args.get(0, 1) - 1);
+    }else if(command == 'K'){ //EL
+        unsigned int mode = args.get(0, 0);
+        if(mode == 0)
+            eraseCells(cursorRow, cursorColumn, columns);
+        else if(mode == 1)
+            eraseCells(cursorRow, 0, cursorColumn + 1);
+        else if(mode == 2)
+            eraseCells(cursorRow, 0, columns);
+    }else if(command == 'J'){ //ED, 3 (the scrollback) is ignored
+        unsigned int mode = args.get(0, 0);
+        if(mode == 0){
+            eraseCells(cursorRow, cursorColumn, columns);
+            for(int row = cursorRow + 1; row < rows; row++)
+                eraseCells(row, 0, columns);
+        }else if(mode == 1){
+            for(int row = 0; row < cursorRow; row++)
+                eraseCells(row, 0, columns);
+            eraseCells(cursorRow, 0, cursorColumn + 1);
+        }else if(mode == 2){
+            for(int row = 0; row < rows; row++)
+                eraseCells(row, 0, columns);
+        }
+    }else if(command == 'X'){ //ECH
+        eraseCells(cursorRow, cursorColumn, cursorColumn + std::min(static_cast<int>(args.get(0, 1)), columns - cursorColumn));
+    }else if(command == 'r'){ //DECSTBM
+        int top = args.get(0, 1) - 1;
+        int bottom = std::min(static_cast<int>(args.get(1, rows)), rows) - 1;
+        if(top >= bottom)
+            return;
+        scrollTop = top;
+        scrollBottom = bottom;
+        cursorColumn = 0;
+        cursorRow = 0;
+        wrapPending = false;
+    }else if(command == 'S'){ //SU
+        grid->scrollRegionUp(scrollTop, scrollBottom, args.get(0, 1));
+    }else if(command == 'T'){ //SD
+        grid->scrollRegionDown(scrollTop, scrollBottom, args.get(0, 1));
+    }else if(command == 'L' || command == 'M'){ //IL and DL, only inside the scroll region
+        if(cursorRow < scrollTop || cursorRow > scrollBottom)
+            return;
+        if(command == 'L')
+            grid->scrollRegionDown(cursorRow, scrollBottom, args.get(0, 1));
+        else
+            grid->scrollRegionUp(cursorRow, scrollBottom, args.get(0, 1));
+        cursorColumn = 0;
+        wrapPending = false;
+    }
+}
+
+void TerminalModel::selectGraphicRendition(const CsiParameters& args){
+    if(args.size() == 0){
+        pen = Grid::blankCell();
+        return;
+    }
+
+    for(int i = 0; i < args.size(); i++){
+        //sub-parameters are only meaningful after 38 and 48, which consume their own
+        if(args.isSubParameter(i))
+            continue;
+
+        unsigned int value = args.values[i];
+        if(value == 0){
+            pen = Grid::blankCell();
+        }else if(value == 1){
+            pen.attributes |= ATTR_BOLD;
+        }else if(value == 4){
+            pen.attributes |= ATTR_UNDERLINE;
+        }else if(value == 7){
+            pen.attributes |= ATTR_INVERSE;
+        }else if(value == 22){
+            pen.attributes &= ~ATTR_BOLD;
+        }else if(value == 24){
+            pen.attributes &= ~ATTR_UNDERLINE;
+        }else if(value == 27){
+            pen.attributes &= ~ATTR_INVERSE;
+        }else if(value >= 30 && value <= 37){
+            pen.foreground = value - 30;
+            pen.attributes |= ATTR_FOREGROUND;
+        }else if(value == 39){
+            //zeroed too, so text in the default colors compares equal to a blank cell
+            pen.foreground = 0;
+            pen.attributes &= ~ATTR_FOREGROUND;
+        }else if(value >= 40 && value <= 47){
+            pen.background = value - 40;
+            pen.attributes |= ATTR_BACKGROUND;
+        }else if(value == 49){
+            pen.background = 0;
+            pen.attributes &= ~ATTR_BACKGROUND;
+        }else if(value >= 90 && value <= 97){
+            pen.foreground = value - 90 + 8;
+            pen.attributes |= ATTR_FOREGROUND;
+        }else if(value >= 100 && value <= 107){
+            pen.background = value - 100 + 8;
+            pen.attributes |= ATTR_BACKGROUND;
+        }else if(value == 38 || value == 48){
+            int color;
+            i = parseExtendedColor(args, i, color);
+            if(color < 0)
+                continue;
+            if(value == 38){
+                pen.foreground = color;
+                pen.attributes |= ATTR_FOREGROUND;
+            }else{
+                pen.background = color;
+                pen.attributes |= ATTR_BACKGROUND;
+            }
+        }
+    }
+}
+
+/*
+    Reads the color after a 38 or 48 at index, either 5;N for a palette index or
+    2;R;G;B for truecolor, which is stored as the nearest palette color.
+    The colon forms 5:N, 2:R:G:B and 2:ID:R:G:B are accepted too.
+    Sets color to -1 when the sequence is malformed and returns the index of
+    the last parameter consumed.
+*/
+int TerminalModel::parseExtendedColor(const CsiParameters& args, int index, int& color){
+    color = -1;
+
+    //with colons everything belongs to the 38 or 48, with semicolons it runs into the following parameters
+    bool colonForm = args.isSubParameter(index + 1);
+    int end = index + 1;
+    if(colonForm){
+        while(end < args.size() && args.isSubParameter(end))
+            end++;
+    }else{
+        end = args.size();
+    }
+    if(index + 1 >= end)
+        return index;
+
+    unsigned int mode = args.values[index + 1];
+    int last;
+    if(mode == 5){
+        last = index + 2;
+        if(last < end)
+            color = std::min(args.values[last], static_cast<uint16_t>(255));
+    }else if(mode == 2){
+        int red = index + 2;
+        //the colon form may carry a color space id first, usually left empty
+        if(colonForm && end - red >= 4)
+            red++;
+        last = red + 2;
+        if(last < end)
+            color = nearestPaletteColor(std::min(args.values[red], static_cast<uint16_t>(255)), std::min(args.values[red + 1], static_cast<uint16_t>(255)), std::min(args.values[red + 2], static_cast<uint16_t>(255)));
+    }else{
+        last = index + 1;
+    }
+
+    return colonForm ? end - 1 : std::min(last, end - 1);
+}
+
+void TerminalModel::setPrivateMode(unsigned int mode, bool enabled){
+    if(mode == 47){
+        switchScreen(enabled);
+    }else if(mode == 1047){
+        //the alternate screen is left blank for next time
+        if(!enabled && grid == &alternateGrid)
+            grid->clear();
+        switchScreen(enabled);
+    }else if(mode == 1048){
+        if(enabled)
+            saveCursor();
+        else
+            restoreCursor();
+    }else if(mode == 1049){
+        if(enabled && grid != &alternateGrid){
+            saveCursor();
+            switchScreen(true);
+            grid->clear();
+        }else if(!enabled && grid == &alternateGrid){
+            switchScreen(false);
+            restoreCursor();
+        }
+    }else if(mode == 2004){
+        bracketedPaste = enabled;
+    }else if(mode == 2026){
+        synchronizedOutput = enabled;
+    }
+}
+
+void TerminalModel::saveCursor(){
+    savedCursor = {cursorColumn, cursorRow, pen, wrapPending};
+}
+
+void TerminalModel::restoreCursor(){
+    cursorColumn = std::min(savedCursor.column, columns - 1);
+    cursorRow = std::min(savedCursor.row, rows - 1);
+    pen = savedCursor.pen;
+    wrapPending = savedCursor.wrapPending;
+}
+
+//both grids always have the current size, so this never copies or allocates
+void TerminalModel::switchScreen(bool alternate){
+    Grid* screen = alternate ? &alternateGrid : &primaryGrid;
+    if(screen == grid)
+        return;
+
+    grid = screen;
+    //the alternate screen has no history to look at
+    viewOffset = 0;
+    grid->markAllDirty();
+}
+
+/*
+    DECRQM, answered with CSI [?] mode ; state $ y where state is 1 for set,
+    2 for reset and 0 for a mode this terminal doesn't know.
+*/
+void TerminalModel::reportMode(unsigned int mode, bool isPrivate){
+    int state = 0;
+    if(isPrivate && (mode == 47 || mode == 1047 || mode == 1049))
+        state = grid == &alternateGrid ? 1 : 2;
+    else if(isPrivate && mode == 2004)
+        state = bracketedPaste ? 1 : 2;
+    else if(isPrivate && mode == 2026)
+        state = synchronizedOutput ? 1 : 2;
+
+    replies += isPrivate ? "\e[?" : "\e[";
+    replies += std::to_string(mode) + ";" + std::to_string(state) + "$y";
+}
+
+void TerminalModel::handleOSCSequence(const std::string&){
+}
+
+void TerminalModel::handleDCSSequence(){
+    return;
+}
+
+void TerminalModel::print(const char* characters, size_t length){
+    putRun(characters, length);
+}
+
+void TerminalModel::printCodepoints(const char32_t* codepoints, size_t length){
+    for(size_t i = 0; i < length; i++)
+        putCodepoint(codepoints[i]);
+}
+
+void TerminalModel::execute(char control){
+    handleAsciiCode(control);
+}
+
+void TerminalModel::escDispatch(const std::string& intermediates, char final){
+    escapeSequenceCount++;
+    if(intermediates.empty())
+        handleSingleCharacterSequence(final);
+}
+
+void TerminalModel::csiDispatch(const CsiParameters& parameters, const std::string& intermediates, char privateMarker, char final){
+    escapeSequenceCount++;
+    if(privateMarker == '?'){
+        if(intermediates.empty() && (final == 'h' || final == 'l')){
+            for(int i = 0; i < parameters.size(); i++)
+                setPrivateMode(parameters.values[i], final == 'h');
+        }else if(intermediates == "$" && final == 'p'){
+            reportMode(parameters.get(0, 0), true);
+        }
+    }else if(privateMarker == '='){
+        // handle set mode sequences
+    }else if(privateMarker == 0 && intermediates.empty()){
+        handleCSISequence(parameters, final);
+    }else if(privateMarker == 0 && intermediates == "$" && final == 'p'){
+        reportMode(parameters.get(0, 0), false);
+    }
+}
+
+void TerminalModel::oscDispatch(const std::string& data){
+    escapeSequenceCount++;
+    handleOSCSequence(data);
+}
+
+//no DCS string is supported yet, the parser consumes them and they are counted and dropped here
+void TerminalModel::dcsHook(const CsiParameters&, const std::string&, char, char){
+    escapeSequenceCount++;
+}
+
+void TerminalModel::dcsPut(char){
+}
+
+void TerminalModel::dcsUnhook(){
+    handleDCSSequence();
+}
+
+int TerminalModel::getColumns(){
+    return columns;
+}
+
+int TerminalModel::getRows(){
+    return rows;
+}
+
+int TerminalModel::getViewOffset(){
+    return viewOffset;
+}
+
+int TerminalModel::getCursorColumn(){
+    return cursorColumn;
+}
+
+int TerminalModel::getCursorRow(){
+    return cursorRow;
+}
+
+Grid& TerminalModel::getGrid(){
+    return *grid;
+}
+
+uint64_t TerminalModel::getEscapeSequenceCount(){
+    return escapeSequenceCount;
+}
+
+bool TerminalModel::isAlternateScreen(){
+    return grid == &alternateGrid;
+}
+
+bool TerminalModel::isBracketedPaste(){
+    return bracketedPaste;
+}
+
+bool TerminalModel::isSynchronized(){
+    return synchronizedOutput;
+}
+
+void TerminalModel::endSynchronizedUpdate(){
+    synchronizedOutput = false;
+}
+
+void TerminalModel::setSynchronizedTimeout(int milliseconds){
+    milliseconds = std::max(MIN_SYNC_TIMEOUT_MS, std::min(milliseconds, MAX_SYNC_TIMEOUT_MS));
+    synchronizedTimeoutNS = milliseconds * 1000000ull;
+}
+
+/*
+    The last complete frame stays up while the application is in a
+    synchronized update. An update that runs past the timeout is ended
+    here, most likely the application died or forgot to end it.
+*/
+bool TerminalModel::holdingFrame(uint64_t nowNS){
+    if(!synchronizedOutput){
+        synchronizedSinceNS = 0;
+        return false;
+    }
+
+    if(synchronizedSinceNS == 0)
+        synchronizedSinceNS = nowNS;
+    if(nowNS - synchronizedSinceNS < synchronizedTimeoutNS)
+        return true;
+
+    endSynchronizedUpdate();
+    synchronizedSinceNS = 0;
+    return false;
+}
+
+uint64_t TerminalModel::getSynchronizedDeadlineNS(){
+    if(synchronizedSinceNS == 0)
+        return 0;
+    return synchronizedSinceNS + synchronizedTimeoutNS;
+}
+
+const std::string& TerminalModel::getReplies(){
+    return replies;
+}
+
+void TerminalModel::clearReplies(){
+    replies.clear();
+}
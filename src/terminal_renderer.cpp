@@ -0,0 +1,332 @@
+#include "../include/terminal_renderer.h"
+
+TerminalRenderer::TerminalRenderer(SDL_Renderer* renderer)
+    : renderer(renderer),
+    paddingX(0),
+    paddingY(0),
+    batchRendering(true),
+    pixelWidth(0),
+    pixelHeight(0),
+    renderTarget(nullptr),
+    targetWidth(0),
+    targetHeight(0),
+    renderTargetCleared(false),
+    renderedCursorColumn(-1),
+    renderedCursorRow(-1),
+    cellsDrawn(0),
+    drawCalls(0)
+{
+    setTheme(DEFAULT_THEME, DEFAULT_THEME[7], DEFAULT_THEME[0]);
+}
+
+TerminalRenderer::~TerminalRenderer(){
+    SDL_DestroyTexture(renderTarget);
+}
+
+void TerminalRenderer::setRenderer(SDL_Renderer* renderer){
+    this->renderer = renderer;
+}
+
+bool TerminalRenderer::loadFont(const std::string& path){
+    font.setFilepath(path);
+    font.setRenderer(renderer);
+
+    return font.load();
+}
+
+void TerminalRenderer::setPadding(unsigned int x, unsigned int y){
+    paddingX = x;
+    paddingY = y;
+    invalidate();
+}
+
+static SDL_FColor toFColor(uint32_t rgb){
+    return {(rgb >> 16 & 0xFF) / 255.0f, (rgb >> 8 & 0xFF) / 255.0f, (rgb & 0xFF) / 255.0f, 1.0f};
+}
+
+void TerminalRenderer::setTheme(const int theme[16], int foreground, int background){
+    for(int i = 0; i < 256; i++)
+        palette[i] = toFColor(paletteColor(i, theme));
+    palette[DEFAULT_FOREGROUND] = toFColor(foreground);
+    palette[DEFAULT_BACKGROUND] = toFColor(background);
+    invalidate();
+}
+
+void TerminalRenderer::setBatchRendering(bool enabled){
+    batchRendering = enabled;
+}
+
+int TerminalRenderer::getCellWidth(){
+    return font.getWidth() + paddingX;
+}
+
+int TerminalRenderer::getCellHeight(){
+    return font.getHeight() + paddingY;
+}
+
+//the last column and row don't need their padding to fit
+int TerminalRenderer::columnsForWidth(int width){
+    return std::max(1, static_cast<int>((width + paddingX) / getCellWidth()));
+}
+
+int TerminalRenderer::rowsForHeight(int height){
+    return std::max(1, static_cast<int>((height + paddingY) / getCellHeight()));
+}
+
+bool TerminalRenderer::resize(int newPixelWidth, int newPixelHeight){
+    pixelWidth = newPixelWidth;
+    pixelHeight = newPixelHeight;
+    invalidate();
+
+    //reused while it fits and at most half of it goes unused
+    bool fits = pixelWidth <= targetWidth && pixelHeight <= targetHeight;
+    if(renderTarget && fits && static_cast<int64_t>(pixelWidth) * pixelHeight * 2 >= static_cast<int64_t>(targetWidth) * targetHeight)
+        return true;
+
+    //room to grow a little before the next reallocation, rounded up to whole 64 pixel blocks
+    targetWidth = (pixelWidth + pixelWidth / 8 + 63) / 64 * 64;
+    targetHeight = (pixelHeight + pixelHeight / 8 + 63) / 64 * 64;
+
+    SDL_DestroyTexture(renderTarget);
+    if(!(renderTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_TARGET, targetWidth, targetHeight))){
+        SDL_Log("Unable to create render target texture: %s\n", SDL_GetError());
+        targetWidth = 0;
+        targetHeight = 0;
+        return false;
+    }
+
+    if(!SDL_SetTextureScaleMode(renderTarget, SDL_SCALEMODE_NEAREST)){
+        SDL_Log("Could not set texture scale mode to SDL_SCALEMODE_NEAREST: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+int TerminalRenderer::getPixelWidth(){
+    return pixelWidth;
+}
+
+int TerminalRenderer::getPixelHeight(){
+    return pixelHeight;
+}
+
+bool TerminalRenderer::needsRender(TerminalModel& model){
+    return !renderTargetCleared
+        || model.getGrid().hasDamage()
+        || model.getCursorColumn() != renderedCursorColumn
+        || model.getCursorRow() + model.getViewOffset() != renderedCursorRow;
+}
+
+void TerminalRenderer::invalidate(){
+    renderTargetCleared = false;
+}
+
+bool TerminalRenderer::render(TerminalModel& model, int x, int y, bool updateContents){
+    if(!renderTarget){
+        SDL_Log("Call to TerminalRenderer::render before the render target exists!\n");
+        return false;
+    }
+
+    if(!SDL_SetRenderTarget(renderer, renderTarget)){
+        SDL_Log("Error setting render target to texture: %s\n", SDL_GetError());
+        return false;
+    }
+
+    //a lost target has to be repainted even while the contents are held
+    if(updateContents || !renderTargetCleared){
+        drawLines(model);
+        renderedCursorColumn = model.getCursorColumn();
+        renderedCursorRow = model.getCursorRow() + model.getViewOffset();
+    }
+
+    if(!SDL_SetRenderTarget(renderer, nullptr)){
+        SDL_Log("Error setting render target back to the window: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_FRect sourceRect = {0, 0, static_cast<float>(pixelWidth), static_cast<float>(pixelHeight)};
+    SDL_FRect destinationRect = {static_cast<float>(x),static_cast<float>(y), static_cast<float>(pixelWidth), static_cast<float>(pixelHeight)};
+    if(!SDL_RenderTexture(renderer, renderTarget, &sourceRect, &destinationRect)){
+        SDL_Log("Error rendering terminal texture to window: %s\n", SDL_GetError());
+        return false;
+    }
+    drawCalls++;
+
+    drawCursor(model, x, y);
+
+    return true;
+}
+
+bool TerminalRenderer::drawCharacter(int column, int row, char32_t character, SDL_FColor color){
+    //blanks and controls have nothing to draw
+    if(character <= U' ')
+        return false;
+
+    float x = column * getCellWidth();
+    float y = row * getCellHeight();
+    if(batchRendering){
+        font.queue(x, y, character, color);
+    }else{
+        font.render(x, y, character, color);
+        drawCalls++;
+    }
+    cellsDrawn++;
+    return true;
+}
+
+void TerminalRenderer::fillRect(const SDL_FRect& rect, SDL_FColor color){
+    if(batchRendering){
+        font.queueRect(rect, color);
+    }else{
+        SDL_SetRenderDrawColorFloat(renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRect(renderer, &rect);
+        drawCalls++;
+    }
+}
+
+/*
+    Fills the row with the default background, then draws runs of cells sharing
+    any other background as one rectangle each, then the glyphs and underlines.
+*/
+void TerminalRenderer::drawRow(Grid& grid, int row, int viewOffset){
+    const Cell* cells = grid.getViewRow(row, viewOffset);
+    int columns = grid.getColumns();
+    float cellWidth = getCellWidth();
+    float rowHeight = getCellHeight();
+    float top = row * rowHeight;
+
+    fillRect({0, top, static_cast<float>(pixelWidth), rowHeight}, palette[DEFAULT_BACKGROUND]);
+
+    int runStart = 0;
+    int runColor = DEFAULT_BACKGROUND;
+    for(int column = 0; column <= columns; column++){
+        int background = DEFAULT_BACKGROUND;
+        if(column < columns){
+            const Cell& cell = cells[column];
+            if(cell.attributes & ATTR_INVERSE)
+                background = cell.attributes & ATTR_FOREGROUND ? cell.foreground : DEFAULT_FOREGROUND;
+            else if(cell.attributes & ATTR_BACKGROUND)
+                background = cell.background;
+        }
+        if(background == runColor)
+            continue;
+
+        if(runColor != DEFAULT_BACKGROUND)
+            fillRect({runStart * cellWidth, top, (column - runStart) * cellWidth, rowHeight}, palette[runColor]);
+        runStart = column;
+        runColor = background;
+    }
+
+    for(int column = 0; column < columns; column++){
+        const Cell& cell = cells[column];
+        int foreground = cell.attributes & ATTR_FOREGROUND ? cell.foreground : DEFAULT_FOREGROUND;
+        //there's no bold face, bold brightens the 8 basic colors instead
+        if((cell.attributes & ATTR_BOLD) && foreground < 8)
+            foreground += 8;
+        if(cell.attributes & ATTR_INVERSE)
+            foreground = cell.attributes & ATTR_BACKGROUND ? cell.background : DEFAULT_BACKGROUND;
+
+        drawCharacter(column, row, cell.codepoint, palette[foreground]);
+
+        //marks are drawn over their base character, the glyphs carry their own offsets
+        if(cell.flags & CELL_COMBINING){
+            for(char32_t mark : grid.getViewCombining(column, row, viewOffset))
+                drawCharacter(column, row, mark, palette[foreground]);
+        }
+
+        if(cell.attributes & ATTR_UNDERLINE)
+            fillRect({column * cellWidth, top + font.getHeight() - 1, cellWidth, 1}, palette[foreground]);
+    }
+}
+
+void TerminalRenderer::drawLines(TerminalModel& model){
+    Grid& grid = model.getGrid();
+    int viewOffset = model.getViewOffset();
+
+    //dirty flags are per screen row, which doesn't line up with the view while scrolled back
+    bool repaintAll = viewOffset > 0 || !renderTargetCleared;
+
+    //a new or reset target has undefined contents, including the area past the last row and column
+    if(!renderTargetCleared){
+        SDL_FColor background = palette[DEFAULT_BACKGROUND];
+        SDL_SetRenderDrawColorFloat(renderer, background.r, background.g, background.b, background.a);
+        SDL_RenderClear(renderer);
+        renderTargetCleared = true;
+        drawCalls++;
+    }
+
+    if(!repaintAll && !grid.hasDamage())
+        return;
+
+    bool rowsDrawn = false;
+    for(int row = 0; row < grid.getRows(); row++){
+        if(!repaintAll && !grid.isDirty(row))
+            continue;
+
+        drawRow(grid, row, viewOffset);
+        rowsDrawn = true;
+    }
+
+    if(batchRendering){
+        //backgrounds, glyphs and underlines of every row go out together
+        if(rowsDrawn)
+            drawCalls++;
+        font.flush();
+    }
+
+    grid.clearDamage();
+}
+
+void TerminalRenderer::drawCursor(TerminalModel& model, int x, int y){
+    int cursorColumn = renderedCursorColumn;
+    int cursorViewRow = renderedCursorRow;
+
+    //scrolled far enough back that the cursor is below the view
+    if(cursorViewRow >= model.getRows())
+        return;
+
+    SDL_FRect cursorRect = {
+        static_cast<float>(x + cursorColumn * getCellWidth()),
+        static_cast<float>(y + cursorViewRow * getCellHeight() + font.getHeight() - 1),
+        static_cast<float>(font.getWidth()),
+        1
+    };
+    SDL_FColor color = palette[DEFAULT_FOREGROUND];
+    SDL_SetRenderDrawColorFloat(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderFillRect(renderer, &cursorRect);
+    drawCalls++;
+}
+
+bool TerminalRenderer::drawOverlay(const std::vector<std::string>& lines, int x, int y){
+    float characterWidth = getCellWidth();
+    float lineHeight = getCellHeight();
+    size_t longestLine = 0;
+    for(const std::string& line : lines)
+        longestLine = std::max(longestLine, line.size());
+
+    //one character of margin on every side keeps the text readable over the terminal contents
+    SDL_FRect background = {
+        static_cast<float>(x),
+        static_cast<float>(y),
+        (longestLine + 2) * characterWidth,
+        (lines.size() + 2) * lineHeight
+    };
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderFillRect(renderer, &background);
+
+    for(size_t row = 0; row < lines.size(); row++){
+        for(size_t column = 0; column < lines[row].size(); column++)
+            font.queue(x + (column + 1) * characterWidth, y + (row + 1) * lineHeight, static_cast<unsigned char>(lines[row][column]));
+    }
+
+    return font.flush();
+}
+
+uint64_t TerminalRenderer::getCellsDrawnCount(){
+    return cellsDrawn;
+}
+
+uint64_t TerminalRenderer::getDrawCallCount(){
+    return drawCalls;
+}
@@ -0,0 +1,66 @@
+#include "../include/utf8_decoder.h"
+
+Utf8Decoder::Utf8Decoder()
+    : partial(0),
+    remaining(0),
+    lowerBoundary(0x80),
+    upperBoundary(0xBF)
+{}
+
+Utf8Decoder::Result Utf8Decoder::decode(unsigned char byte, char32_t& codepoint){
+    if(remaining == 0){
+        if(byte < 0x80){
+            codepoint = byte;
+            return COMPLETE;
+        }
+
+        if(byte >= 0xC2 && byte <= 0xDF){
+            remaining = 1;
+            partial = byte & 0x1F;
+        }else if(byte >= 0xE0 && byte <= 0xEF){
+            //E0 would be overlong below A0, ED would be a surrogate from A0
+            if(byte == 0xE0) lowerBoundary = 0xA0;
+            if(byte == 0xED) upperBoundary = 0x9F;
+            remaining = 2;
+            partial = byte & 0x0F;
+        }else if(byte >= 0xF0 && byte <= 0xF4){
+            //F0 would be overlong below 90, F4 would pass U+10FFFF from 90
+            if(byte == 0xF0) lowerBoundary = 0x90;
+            if(byte == 0xF4) upperBoundary = 0x8F;
+            remaining = 3;
+            partial = byte & 0x07;
+        }else{
+            //stray continuation byte or a lead byte no valid sequence starts with
+            codepoint = REPLACEMENT;
+            return COMPLETE;
+        }
+        return INCOMPLETE;
+    }
+
+    if(byte < lowerBoundary || byte > upperBoundary){
+        reset();
+        codepoint = REPLACEMENT;
+        return REJECTED;
+    }
+
+    lowerBoundary = 0x80;
+    upperBoundary = 0xBF;
+    partial = (partial << 6) | (byte & 0x3F);
+    if(--remaining > 0)
+        return INCOMPLETE;
+
+    codepoint = partial;
+    partial = 0;
+    return COMPLETE;
+}
+
+bool Utf8Decoder::isPending(){
+    return remaining > 0;
+}
+
+void Utf8Decoder::reset(){
+    partial = 0;
+    remaining = 0;
+    lowerBoundary = 0x80;
+    upperBoundary = 0xBF;
+}
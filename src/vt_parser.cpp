@@ -0,0 +1,347 @@
+#include "../include/vt_parser.h"
+
+typedef VtParser::State State;
+typedef VtParser::Action Action;
+
+namespace {
+
+//next state value meaning the byte is handled without leaving the current state
+const uint8_t STAY = 0x0F;
+
+/*
+    Every entry packs the action in the low nibble and the next state (or STAY)
+    in the high nibble, so a transition is a single byte load.
+    Rules are written per state the same way they appear in the DEC parser
+    diagram, with the "anywhere" transitions applied last so they win.
+*/
+struct TransitionTable{
+    uint8_t entries[VtParser::STATE_COUNT][256];
+
+    constexpr TransitionTable(bool eightBitControls)
+        : entries{}
+    {
+        for(int state = 0; state < VtParser::STATE_COUNT; state++)
+            set(state, 0x00, 0xFF, VtParser::IGNORE, STAY);
+
+        //C0 controls other than CAN, SUB and ESC, which are handled anywhere
+        for(int state = 0; state < VtParser::STATE_COUNT; state++){
+            Action c0Action = VtParser::EXECUTE;
+            if(state >= VtParser::DCS_ENTRY && state <= VtParser::DCS_IGNORE)
+                c0Action = state == VtParser::DCS_PASSTHROUGH ? VtParser::PUT : VtParser::IGNORE;
+            else if(state == VtParser::OSC_STRING || state == VtParser::SOS_PM_APC_STRING)
+                c0Action = VtParser::IGNORE;
+
+            set(state, 0x00, 0x17, c0Action, STAY);
+            set(state, 0x19, 0x19, c0Action, STAY);
+            set(state, 0x1C, 0x1F, c0Action, STAY);
+        }
+
+        //bytes 0xA0 and up are printable in both modes, 0x80 to 0x9F only without C1 controls
+        int firstHighPrintable = eightBitControls ? 0xA0 : 0x80;
+
+        set(VtParser::GROUND, 0x20, 0x7E, VtParser::PRINT, STAY);
+        set(VtParser::GROUND, firstHighPrintable, 0xFF, VtParser::PRINT, STAY);
+
+        set(VtParser::ESCAPE, 0x20, 0x2F, VtParser::COLLECT, VtParser::ESCAPE_INTERMEDIATE);
+        set(VtParser::ESCAPE, 0x30, 0x7E, VtParser::ESC_DISPATCH, VtParser::GROUND);
+        set(VtParser::ESCAPE, 'P', 'P', VtParser::NONE, VtParser::DCS_ENTRY);
+        set(VtParser::ESCAPE, 'X', 'X', VtParser::NONE, VtParser::SOS_PM_APC_STRING);
+        set(VtParser::ESCAPE, '[', '[', VtParser::NONE, VtParser::CSI_ENTRY);
+        set(VtParser::ESCAPE, ']', ']', VtParser::NONE, VtParser::OSC_STRING);
+        set(VtParser::ESCAPE, '^', '_', VtParser::NONE, VtParser::SOS_PM_APC_STRING);
+
+        set(VtParser::ESCAPE_INTERMEDIATE, 0x20, 0x2F, VtParser::COLLECT, STAY);
+        set(VtParser::ESCAPE_INTERMEDIATE, 0x30, 0x7E, VtParser::ESC_DISPATCH, VtParser::GROUND);
+
+        //':' is accepted as a parameter byte so sub-parameters reach the handler
+        set(VtParser::CSI_ENTRY, 0x20, 0x2F, VtParser::COLLECT, VtParser::CSI_INTERMEDIATE);
+        set(VtParser::CSI_ENTRY, 0x30, 0x3B, VtParser::PARAM, VtParser::CSI_PARAM);
+        set(VtParser::CSI_ENTRY, 0x3C, 0x3F, VtParser::COLLECT, VtParser::CSI_PARAM);
+        set(VtParser::CSI_ENTRY, 0x40, 0x7E, VtParser::CSI_DISPATCH, VtParser::GROUND);
+
+        set(VtParser::CSI_PARAM, 0x20, 0x2F, VtParser::COLLECT, VtParser::CSI_INTERMEDIATE);
+        set(VtParser::CSI_PARAM, 0x30, 0x3B, VtParser::PARAM, STAY);
+        set(VtParser::CSI_PARAM, 0x3C, 0x3F, VtParser::NONE, VtParser::CSI_IGNORE);
+        set(VtParser::CSI_PARAM, 0x40, 0x7E, VtParser::CSI_DISPATCH, VtParser::GROUND);
+
+        set(VtParser::CSI_INTERMEDIATE, 0x20, 0x2F, VtParser::COLLECT, STAY);
+        set(VtParser::CSI_INTERMEDIATE, 0x30, 0x3F, VtParser::NONE, VtParser::CSI_IGNORE);
+        set(VtParser::CSI_INTERMEDIATE, 0x40, 0x7E, VtParser::CSI_DISPATCH, VtParser::GROUND);
+
+        set(VtParser::CSI_IGNORE, 0x40, 0x7E, VtParser::NONE, VtParser::GROUND);
+
+        set(VtParser::DCS_ENTRY, 0x20, 0x2F, VtParser::COLLECT, VtParser::DCS_INTERMEDIATE);
+        set(VtParser::DCS_ENTRY, 0x30, 0x3B, VtParser::PARAM, VtParser::DCS_PARAM);
+        set(VtParser::DCS_ENTRY, 0x3C, 0x3F, VtParser::COLLECT, VtParser::DCS_PARAM);
+        set(VtParser::DCS_ENTRY, 0x40, 0x7E, VtParser::NONE, VtParser::DCS_PASSTHROUGH);
+
+        set(VtParser::DCS_PARAM, 0x20, 0x2F, VtParser::COLLECT, VtParser::DCS_INTERMEDIATE);
+        set(VtParser::DCS_PARAM, 0x30, 0x3B, VtParser::PARAM, STAY);
+        set(VtParser::DCS_PARAM, 0x3C, 0x3F, VtParser::NONE, VtParser::DCS_IGNORE);
+        set(VtParser::DCS_PARAM, 0x40, 0x7E, VtParser::NONE, VtParser::DCS_PASSTHROUGH);
+
+        set(VtParser::DCS_INTERMEDIATE, 0x20, 0x2F, VtParser::COLLECT, STAY);
+        set(VtParser::DCS_INTERMEDIATE, 0x30, 0x3F, VtParser::NONE, VtParser::DCS_IGNORE);
+        set(VtParser::DCS_INTERMEDIATE, 0x40, 0x7E, VtParser::NONE, VtParser::DCS_PASSTHROUGH);
+
+        set(VtParser::DCS_PASSTHROUGH, 0x20, 0x7E, VtParser::PUT, STAY);
+        set(VtParser::DCS_PASSTHROUGH, firstHighPrintable, 0xFF, VtParser::PUT, STAY);
+
+        //BEL is the xterm OSC terminator, ESC \ arrives through the ESC transition below
+        set(VtParser::OSC_STRING, 0x07, 0x07, VtParser::NONE, VtParser::GROUND);
+        set(VtParser::OSC_STRING, 0x20, 0x7F, VtParser::OSC_PUT, STAY);
+        set(VtParser::OSC_STRING, firstHighPrintable, 0xFF, VtParser::OSC_PUT, STAY);
+
+        for(int state = 0; state < VtParser::STATE_COUNT; state++){
+            set(state, 0x18, 0x18, VtParser::EXECUTE, VtParser::GROUND);
+            set(state, 0x1A, 0x1A, VtParser::EXECUTE, VtParser::GROUND);
+            set(state, 0x1B, 0x1B, VtParser::NONE, VtParser::ESCAPE);
+
+            if(eightBitControls){
+                set(state, 0x80, 0x8F, VtParser::EXECUTE, VtParser::GROUND);
+                set(state, 0x90, 0x90, VtParser::NONE, VtParser::DCS_ENTRY);
+                set(state, 0x91, 0x97, VtParser::EXECUTE, VtParser::GROUND);
+                set(state, 0x98, 0x98, VtParser::NONE, VtParser::SOS_PM_APC_STRING);
+                set(state, 0x99, 0x9A, VtParser::EXECUTE, VtParser::GROUND);
+                set(state, 0x9B, 0x9B, VtParser::NONE, VtParser::CSI_ENTRY);
+                set(state, 0x9C, 0x9C, VtParser::NONE, VtParser::GROUND);
+                set(state, 0x9D, 0x9D, VtParser::NONE, VtParser::OSC_STRING);
+                set(state, 0x9E, 0x9F, VtParser::NONE, VtParser::SOS_PM_APC_STRING);
+            }
+        }
+    }
+
+    constexpr void set(int state, int first, int last, Action action, uint8_t nextState){
+        for(int byte = first; byte <= last; byte++)
+            entries[state][byte] = static_cast<uint8_t>(action | (nextState << 4));
+    }
+};
+
+struct StateActions{
+    Action entry[VtParser::STATE_COUNT];
+    Action exit[VtParser::STATE_COUNT];
+
+    constexpr StateActions()
+        : entry{},
+        exit{}
+    {
+        entry[VtParser::ESCAPE] = VtParser::CLEAR;
+        entry[VtParser::CSI_ENTRY] = VtParser::CLEAR;
+        entry[VtParser::DCS_ENTRY] = VtParser::CLEAR;
+        entry[VtParser::DCS_PASSTHROUGH] = VtParser::HOOK;
+        entry[VtParser::OSC_STRING] = VtParser::OSC_START;
+
+        exit[VtParser::DCS_PASSTHROUGH] = VtParser::UNHOOK;
+        exit[VtParser::OSC_STRING] = VtParser::OSC_END;
+    }
+};
+
+constexpr TransitionTable SEVEN_BIT_TABLE(false);
+constexpr TransitionTable EIGHT_BIT_TABLE(true);
+constexpr StateActions STATE_ACTIONS;
+
+static_assert(SEVEN_BIT_TABLE.entries[VtParser::GROUND]['A'] == (VtParser::PRINT | (STAY << 4)), "printable bytes must print in ground");
+static_assert(EIGHT_BIT_TABLE.entries[VtParser::GROUND][0x9B] == (VtParser::NONE | (VtParser::CSI_ENTRY << 4)), "CSI must enter CSI_ENTRY with C1 controls enabled");
+
+}
+
+VtParser::VtParser(VtParserHandler* handler)
+    : handler(handler),
+    state(GROUND),
+    eightBitControls(false),
+    parametersFull(false),
+    privateMarker(0),
+    tooManyIntermediates(false)
+{
+    clear();
+    intermediates.reserve(MAX_INTERMEDIATES);
+    oscData.reserve(MAX_OSC_BYTES);
+}
+
+void VtParser::setEightBitControls(bool enabled){
+    eightBitControls = enabled;
+    utf8Decoder.reset();
+}
+
+VtParser::State VtParser::getState(){
+    return state;
+}
+
+void VtParser::parse(const char* data, size_t length){
+    const TransitionTable& table = eightBitControls ? EIGHT_BIT_TABLE : SEVEN_BIT_TABLE;
+
+    for(size_t i = 0; i < length; i++){
+        //most output is long printable runs, hand them over without going through the table
+        if(state == GROUND){
+            while(i < length){
+                if(!eightBitControls && (utf8Decoder.isPending() || static_cast<unsigned char>(data[i]) >= 0x80)){
+                    i = decodeUtf8(data, i, length);
+                    continue;
+                }
+
+                size_t runLength = findNonPrintable(data + i, length - i);
+                if(runLength == 0)
+                    break;
+                handler->print(data + i, runLength);
+                i += runLength;
+            }
+            if(i == length)
+                break;
+        }
+
+        unsigned char byte = data[i];
+        uint8_t entry = table.entries[state][byte];
+        Action action = static_cast<Action>(entry & 0x0F);
+        uint8_t nextState = entry >> 4;
+
+        if(nextState == STAY)
+            performAction(action, byte);
+        else
+            transition(static_cast<State>(nextState), action, byte);
+    }
+}
+
+/*
+    Decodes from start up to the next ascii byte or the end of the data and returns
+    where it stopped. A sequence cut off by the end of the data stays pending for the
+    next call, one cut off by an ascii byte is replaced with U+FFFD.
+*/
+size_t VtParser::decodeUtf8(const char* data, size_t start, size_t length){
+    size_t count = 0;
+    size_t i = start;
+
+    while(i < length){
+        unsigned char byte = data[i];
+        if(byte < 0x80){
+            if(utf8Decoder.isPending()){
+                utf8Decoder.reset();
+                decoded[count++] = Utf8Decoder::REPLACEMENT;
+            }
+            break;
+        }
+
+        char32_t codepoint;
+        Utf8Decoder::Result result = utf8Decoder.decode(byte, codepoint);
+        //a rejected byte may start the next sequence, so it's decoded again
+        if(result != Utf8Decoder::REJECTED)
+            i++;
+        if(result != Utf8Decoder::INCOMPLETE)
+            decoded[count++] = codepoint;
+
+        if(count == DECODE_BUFFER_SIZE){
+            handler->printCodepoints(decoded, count);
+            count = 0;
+        }
+    }
+
+    if(count > 0)
+        handler->printCodepoints(decoded, count);
+    return i;
+}
+
+void VtParser::transition(State nextState, Action action, unsigned char byte){
+    performAction(STATE_ACTIONS.exit[state], byte);
+    performAction(action, byte);
+    state = nextState;
+    performAction(STATE_ACTIONS.entry[state], byte);
+}
+
+void VtParser::clear(){
+    parameters.count = 0;
+    parameters.subParameterMask = 0;
+    parametersFull = false;
+    intermediates.clear();
+    privateMarker = 0;
+    tooManyIntermediates = false;
+}
+
+void VtParser::addParameterByte(unsigned char byte){
+    //the first byte of any kind starts the first parameter, so ";5" is two parameters
+    if(parameters.count == 0){
+        parameters.values[0] = 0;
+        parameters.count = 1;
+    }
+
+    if(byte == ';' || byte == ':'){
+        if(parameters.count == CsiParameters::MAX_PARAMETERS){
+            parametersFull = true;
+            return;
+        }
+        if(byte == ':')
+            parameters.subParameterMask |= 1u << parameters.count;
+        parameters.values[parameters.count++] = 0;
+        return;
+    }
+
+    if(parametersFull)
+        return;
+
+    uint16_t& value = parameters.values[parameters.count - 1];
+    unsigned int newValue = value * 10u + (byte - '0');
+    value = newValue > CsiParameters::MAX_VALUE ? CsiParameters::MAX_VALUE : newValue;
+}
+
+void VtParser::performAction(Action action, unsigned char byte){
+    char character = static_cast<char>(byte);
+
+    switch(action){
+        case NONE:
+        case IGNORE:
+            break;
+        case PRINT:
+            //only reached for 0xA0 and up with C1 controls on, which are Latin-1
+            if(byte < 0x80){
+                handler->print(&character, 1);
+            }else{
+                char32_t codepoint = byte;
+                handler->printCodepoints(&codepoint, 1);
+            }
+            break;
+        case EXECUTE:
+            handler->execute(character);
+            break;
+        case CLEAR:
+            clear();
+            break;
+        case COLLECT:
+            if(byte >= 0x3C && byte <= 0x3F)
+                privateMarker = character;
+            else if(intermediates.size() < MAX_INTERMEDIATES)
+                intermediates.push_back(character);
+            else
+                tooManyIntermediates = true;
+            break;
+        case PARAM:
+            addParameterByte(byte);
+            break;
+        case ESC_DISPATCH:
+            if(!tooManyIntermediates)
+                handler->escDispatch(intermediates, character);
+            break;
+        case CSI_DISPATCH:
+            if(!tooManyIntermediates)
+                handler->csiDispatch(parameters, intermediates, privateMarker, character);
+            break;
+        case HOOK:
+            handler->dcsHook(parameters, intermediates, privateMarker, character);
+            break;
+        case PUT:
+            handler->dcsPut(character);
+            break;
+        case UNHOOK:
+            handler->dcsUnhook();
+            break;
+        case OSC_START:
+            oscData.clear();
+            break;
+        case OSC_PUT:
+            if(oscData.size() < MAX_OSC_BYTES)
+                oscData.push_back(character);
+            break;
+        case OSC_END:
+            handler->oscDispatch(oscData);
+            break;
+        case ACTION_COUNT:
+            break;
+    }
+}
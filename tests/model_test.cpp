@@ -0,0 +1,809 @@
+/*
+    Checks for the emulator model. Each case feeds bytes to a TerminalModel,
+    or to the VtParser under it, and compares the text of the grid, history
+    included, or what was dispatched with what it should be. No SDL, window
+    or shell is needed.
+
+    usage: tiny_term_model_test
+    Prints each failed check and exits with 1 if there were any.
+*/
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../include/terminal_model.h"
+
+//counts heap allocations, like the benchmark, so the cases that claim none can check it
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size){
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if(void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept{
+    std::free(memory);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+static void check(bool passed, const char* expression, const char* file, int line){
+    if(!passed){
+        std::printf("%s:%d: check failed: %s\n", file, line, expression);
+        failures++;
+    }
+}
+
+static void output(TerminalModel& model, const std::string& bytes){
+    model.processOutput(bytes.data(), bytes.size());
+}
+
+//line 0 is the oldest history line, the screen follows the history. Trailing blanks are dropped
+static std::string lineText(Grid& grid, int line){
+    int historySize = grid.getHistorySize();
+    const Cell* cells = line < historySize ? grid.getViewRow(0, historySize - line) : grid.getViewRow(line - historySize, 0);
+
+    std::string text;
+    for(int column = 0; column < grid.getColumns(); column++)
+        text += cells[column].codepoint < 0x80 ? static_cast<char>(cells[column].codepoint) : '?';
+    while(!text.empty() && text.back() == ' ')
+        text.pop_back();
+    return text;
+}
+
+static std::string screenText(TerminalModel& model, int row){
+    return lineText(model.getGrid(), model.getGrid().getHistorySize() + row);
+}
+
+//every line of the history and the screen, with the history rewrapped after a resize pulled in first
+static std::vector<std::string> allLines(TerminalModel& model){
+    model.scrollView(1 << 20);
+    model.scrollViewToBottom();
+
+    Grid& grid = model.getGrid();
+    std::vector<std::string> lines;
+    for(int line = 0; line < grid.getHistorySize() + grid.getRows(); line++)
+        lines.push_back(lineText(grid, line));
+    return lines;
+}
+
+//keeps the parameters of the last CSI sequence and every decoded character, for checking what the parser hands over
+class ParserRecorder : public VtParserHandler{
+public:
+    CsiParameters parameters{};
+    char final = 0;
+    int dispatchCount = 0;
+    std::u32string printed;
+
+    void print(const char*, size_t) override {}
+    void printCodepoints(const char32_t* codepoints, size_t length) override {
+        printed.append(codepoints, length);
+    }
+    void execute(char) override {}
+    void escDispatch(const std::string&, char) override {}
+    void csiDispatch(const CsiParameters& csiParameters, const std::string&, char, char csiFinal) override {
+        parameters = csiParameters;
+        final = csiFinal;
+        dispatchCount++;
+    }
+    void oscDispatch(const std::string&) override {}
+    void dcsHook(const CsiParameters&, const std::string&, char, char) override {}
+    void dcsPut(char) override {}
+    void dcsUnhook() override {}
+};
+
+static void parse(VtParser& parser, const std::string& bytes){
+    parser.parse(bytes.data(), bytes.size());
+}
+
+static void testSplitSequences(){
+    TerminalModel model;
+    model.resize(10, 4);
+
+    //a CSI sequence cut at every possible point still moves the cursor once
+    const std::string sequence = "\e[3;5H";
+    for(size_t cut = 1; cut < sequence.size(); cut++){
+        output(model, "\e[H");
+        output(model, sequence.substr(0, cut));
+        output(model, sequence.substr(cut));
+        CHECK(model.getCursorColumn() == 4 && model.getCursorRow() == 2);
+    }
+
+    //an OSC string and a UTF-8 character split in the middle, neither leaves text behind
+    output(model, "\e[H\e]0;ti");
+    output(model, "tle\a\xc3");
+    output(model, "\xa9x");
+    CHECK(model.getGrid().getRow(0)[0].codepoint == 0xE9);
+    CHECK(screenText(model, 0) == "?x");
+}
+
+static void testCsiParameters(){
+    ParserRecorder recorder;
+    VtParser parser(&recorder);
+
+    parse(parser, "\e[;5m");
+    CHECK(recorder.parameters.size() == 2);
+    CHECK(recorder.parameters.get(0, 1) == 1 && recorder.parameters.get(1, 1) == 5);
+    CHECK(recorder.parameters.get(2, 7) == 7);
+
+    //values saturate instead of overflowing
+    parse(parser, "\e[70000;65535;65536;99999999999A");
+    CHECK(recorder.final == 'A' && recorder.parameters.size() == 4);
+    for(int i = 0; i < 4; i++)
+        CHECK(recorder.parameters.values[i] == CsiParameters::MAX_VALUE);
+
+    //parameters past the 32nd are dropped, the sequence is still dispatched
+    std::string many = "\e[";
+    for(int i = 1; i <= 40; i++)
+        many += std::to_string(i) + (i < 40 ? ";" : "m");
+    int dispatched = recorder.dispatchCount;
+    parse(parser, many);
+    CHECK(recorder.dispatchCount == dispatched + 1);
+    CHECK(recorder.parameters.size() == CsiParameters::MAX_PARAMETERS);
+    CHECK(recorder.parameters.values[0] == 1 && recorder.parameters.values[CsiParameters::MAX_PARAMETERS - 1] == 32);
+
+    //colons mark sub-parameters of the parameter before them
+    parse(parser, "\e[1;38:2::10:20:30;4m");
+    CHECK(recorder.parameters.size() == 8);
+    CHECK(!recorder.parameters.isSubParameter(0) && !recorder.parameters.isSubParameter(1));
+    for(int i = 2; i < 7; i++)
+        CHECK(recorder.parameters.isSubParameter(i));
+    CHECK(!recorder.parameters.isSubParameter(7));
+    CHECK(recorder.parameters.values[3] == 0 && recorder.parameters.values[4] == 10 && recorder.parameters.values[7] == 4);
+
+    //the parameters of one sequence don't leak into the next
+    parse(parser, "\e[m");
+    CHECK(recorder.parameters.size() == 0 && recorder.parameters.subParameterMask == 0);
+
+    //accumulating parameters never touches the heap
+    uint64_t allocationsBefore = allocationCount.load();
+    for(int i = 0; i < 1000; i++)
+        parse(parser, many);
+    CHECK(allocationCount.load() == allocationsBefore);
+}
+
+static void testCursorMovement(){
+    TerminalModel model;
+    model.resize(10, 6);
+
+    //CUP is 1-based and clamped to the screen, 0 means 1
+    output(model, "\e[99;99H");
+    CHECK(model.getCursorColumn() == 9 && model.getCursorRow() == 5);
+    output(model, "\e[0;0H");
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 0);
+    output(model, "\e[3;4f");
+    CHECK(model.getCursorColumn() == 3 && model.getCursorRow() == 2);
+
+    output(model, "\e[20C");
+    CHECK(model.getCursorColumn() == 9);
+    output(model, "\e[20D");
+    CHECK(model.getCursorColumn() == 0);
+    output(model, "\e[5G\e[2d");
+    CHECK(model.getCursorColumn() == 4 && model.getCursorRow() == 1);
+
+    //like xterm, CUU stops at the top margin from anywhere below it and CUD at the bottom margin from anywhere above it
+    output(model, "\e[2;4r\e[4;1H\e[10A");
+    CHECK(model.getCursorRow() == 1);
+    output(model, "\e[10B");
+    CHECK(model.getCursorRow() == 3);
+    output(model, "\e[6;1H\e[10A");
+    CHECK(model.getCursorRow() == 1);
+    output(model, "\e[1;1H\e[10A");
+    CHECK(model.getCursorRow() == 0);
+    output(model, "\e[5;1H\e[10B");
+    CHECK(model.getCursorRow() == 5);
+
+    //any movement cancels a pending wrap, the next character overwrites the last column
+    output(model, "\e[r\e[1;1H0123456789\e[1;10HX");
+    CHECK(screenText(model, 0) == "012345678X" && screenText(model, 1) == "");
+}
+
+static void testEraseUsesPenBackground(){
+    TerminalModel model;
+    model.resize(10, 3);
+    output(model, "abcdefghij\r\nabcdefghij");
+
+    //erased cells take the background but not the foreground or other attributes
+    output(model, "\e[1;31;44m\e[1;4H\e[K");
+    CHECK(screenText(model, 0) == "abc");
+    const Cell* cells = model.getGrid().getRow(0);
+    CHECK(cells[2].attributes == 0);
+    for(int column = 3; column < 10; column++)
+        CHECK(cells[column].codepoint == U' ' && cells[column].background == 4 && cells[column].attributes == ATTR_BACKGROUND && cells[column].foreground == 0);
+
+    //ED 2 in the default colors leaves plain blanks
+    output(model, "\e[m\e[2J");
+    for(int row = 0; row < 3; row++)
+        for(int column = 0; column < 10; column++)
+            CHECK(Grid::isBlank(model.getGrid().getRow(row)[column]));
+
+    output(model, "\e[42m\e[1;1Habcdef\e[1;2H\e[2X");
+    cells = model.getGrid().getRow(0);
+    CHECK(screenText(model, 0) == "a  def");
+    CHECK(cells[1].background == 2 && cells[2].background == 2 && cells[3].background == 2 && (cells[3].attributes & ATTR_BACKGROUND));
+    CHECK(model.getCursorColumn() == 1);
+}
+
+static void testEraseSplitsWideCharacters(){
+    TerminalModel model;
+    model.resize(10, 3);
+    //U+4E2D takes columns 2 and 3
+    const std::string text = "ab\xe4\xb8\xad" "cd";
+
+    //ECH starting on the right half blanks the left half too
+    output(model, "\e[1;1H" + text + "\e[1;4H\e[X");
+    const Cell* cells = model.getGrid().getRow(0);
+    CHECK(Grid::isBlank(cells[2]) && Grid::isBlank(cells[3]));
+    CHECK(screenText(model, 0) == "ab  cd");
+
+    //ECH ending on the left half blanks the right half too
+    output(model, "\e[1;1H" + text + "\e[1;2H\e[2X");
+    CHECK(Grid::isBlank(cells[2]) && Grid::isBlank(cells[3]));
+    CHECK(screenText(model, 0) == "a   cd");
+
+    //EL 1 ending on the left half, EL 0 starting on the right half
+    output(model, "\e[2;1H" + text + "\e[2;3H\e[1K");
+    cells = model.getGrid().getRow(1);
+    CHECK(Grid::isBlank(cells[3]) && screenText(model, 1) == "    cd");
+    output(model, "\e[3;1H" + text + "\e[3;4H\e[K");
+    cells = model.getGrid().getRow(2);
+    CHECK(Grid::isBlank(cells[2]) && screenText(model, 2) == "ab");
+}
+
+static std::u32string rowCodepoints(TerminalModel& model, int row, int length){
+    std::u32string codepoints;
+    for(int column = 0; column < length; column++)
+        codepoints += model.getGrid().getRow(row)[column].codepoint;
+    return codepoints;
+}
+
+static void testInvalidUtf8(){
+    TerminalModel model;
+    model.resize(10, 8);
+
+    //every maximal invalid subsequence becomes one U+FFFD and the text after it still comes through
+    output(model, "a\xff" "b");
+    CHECK(rowCodepoints(model, 0, 3) == U"a\ufffd" "b");
+    //overlong forms
+    output(model, "\r\n\xc0\xaf\xe0\x80\xaf");
+    CHECK(rowCodepoints(model, 1, 6) == U"\ufffd\ufffd\ufffd\ufffd\ufffd ");
+    //a surrogate, and a value past U+10FFFF
+    output(model, "\r\n\xed\xa0\x80\xf4\x90\x80\x80");
+    CHECK(rowCodepoints(model, 2, 8) == U"\ufffd\ufffd\ufffd\ufffd\ufffd\ufffd\ufffd ");
+    //a sequence cut short by ascii or an escape sequence
+    output(model, "\r\n\xe4\xb8x\xc3\e[my");
+    CHECK(rowCodepoints(model, 3, 5) == U"\ufffdx\ufffdy ");
+
+    //the values right next to the rejected ranges are accepted
+    ParserRecorder recorder;
+    VtParser parser(&recorder);
+    parse(parser, "\xc2\x80\xe0\xa0\x80\xed\x9f\xbf\xee\x80\x80\xf0\x90\x80\x80\xf4\x8f\xbf\xbf");
+    CHECK(recorder.printed == U"\u0080\u0800\ud7ff\ue000\U00010000\U0010ffff");
+}
+
+static void testCombiningAndWideCharacters(){
+    TerminalModel model;
+    model.resize(6, 5);
+    Grid& grid = model.getGrid();
+
+    //a combining mark attaches to the cell before it and doesn't move the cursor
+    output(model, "e\xcc\x81x");
+    CHECK(grid.getRow(0)[0].codepoint == U'e' && (grid.getRow(0)[0].flags & CELL_COMBINING));
+    CHECK(grid.getViewCombining(0, 0, 0) == U"\u0301");
+    CHECK(grid.getRow(0)[1].codepoint == U'x' && !(grid.getRow(0)[1].flags & CELL_COMBINING));
+    CHECK(model.getCursorColumn() == 2);
+
+    //after a wide character it belongs to the left half
+    output(model, "\r\n\xe4\xb8\xad\xcc\x88");
+    CHECK(model.getCursorColumn() == 2);
+    CHECK((grid.getRow(1)[0].flags & CELL_COMBINING) && (grid.getRow(1)[1].flags & CELL_WIDE_CONTINUATION));
+    CHECK(grid.getViewCombining(0, 1, 0) == U"\u0308");
+
+    //on the last column, with the wrap still pending, it goes to the character written there
+    output(model, "\r\nabcdef\xcc\x81");
+    CHECK(grid.getRow(2)[5].codepoint == U'f' && (grid.getRow(2)[5].flags & CELL_COMBINING));
+    CHECK(model.getCursorRow() == 2);
+
+    //with nothing before it at the start of a line it is dropped
+    output(model, "\r\n\xcc\x81");
+    CHECK(!(grid.getRow(3)[0].flags & CELL_COMBINING) && model.getCursorColumn() == 0);
+
+    //a wide character that doesn't fit on the line moves to the next one whole
+    output(model, "abcde\xe4\xb8\xad");
+    CHECK(screenText(model, 3) == "abcde" && !(grid.getRow(3)[5].flags & CELL_WIDE_CONTINUATION));
+    CHECK(grid.getRow(4)[0].codepoint == 0x4E2D && (grid.getRow(4)[1].flags & CELL_WIDE_CONTINUATION));
+    CHECK(grid.isWrapped(3));
+}
+
+//the cell a character gets when written after sgr, the pen carries over from earlier calls
+static Cell cellAfter(TerminalModel& model, const std::string& sgr){
+    output(model, "\r" + sgr + "x");
+    return model.getGrid().getRow(0)[0];
+}
+
+static void testSelectGraphicRendition(){
+    TerminalModel model;
+    model.resize(10, 2);
+
+    Cell cell = cellAfter(model, "\e[1;4;7;31;42m");
+    CHECK(cell.attributes == (ATTR_BOLD | ATTR_UNDERLINE | ATTR_INVERSE | ATTR_FOREGROUND | ATTR_BACKGROUND));
+    CHECK(cell.foreground == 1 && cell.background == 2);
+    //turning each one off again ends in the same cell as a reset
+    cell = cellAfter(model, "\e[22;24;27;39;49m");
+    Cell reset = cellAfter(model, "\e[m");
+    CHECK(std::memcmp(&cell, &reset, sizeof(Cell)) == 0);
+    CHECK(cell.attributes == 0 && cell.foreground == 0 && cell.background == 0);
+
+    cell = cellAfter(model, "\e[0;93;104m");
+    CHECK(cell.foreground == 11 && cell.background == 12);
+
+    //256 colors with semicolons, the parameters after the color are read as usual
+    cell = cellAfter(model, "\e[0;38;5;123;48;5;200;1m");
+    CHECK(cell.foreground == 123 && cell.background == 200 && (cell.attributes & ATTR_BOLD));
+    //and with colons, values past 255 are clamped
+    cell = cellAfter(model, "\e[0;38:5:45;48:5:300;4m");
+    CHECK(cell.foreground == 45 && cell.background == 255 && (cell.attributes & ATTR_UNDERLINE));
+
+    //truecolor is stored as the nearest palette color
+    cell = cellAfter(model, "\e[0;38;2;255;0;0;48;2;128;128;128m");
+    CHECK(cell.foreground == 196 && cell.background == 244);
+    //the colon form with an empty color space id, with a given one, and without one
+    cell = cellAfter(model, "\e[0;38:2::0:255:0m");
+    CHECK(cell.foreground == 46);
+    cell = cellAfter(model, "\e[0;38:2:1:0:0:255m");
+    CHECK(cell.foreground == 21);
+    cell = cellAfter(model, "\e[0;48:2:255:255:255;7m");
+    CHECK(cell.background == 231 && (cell.attributes & ATTR_INVERSE));
+
+    //a color cut short leaves the pen as it was
+    cell = cellAfter(model, "\e[0;31m\e[38;5m");
+    CHECK(cell.foreground == 1 && (cell.attributes & ATTR_FOREGROUND));
+    cell = cellAfter(model, "\e[38;2;1;2m");
+    CHECK(cell.foreground == 1);
+    cell = cellAfter(model, "\e[38:2:1:2;4m");
+    CHECK(cell.foreground == 1 && (cell.attributes & ATTR_UNDERLINE));
+    //sub-parameters anywhere else are ignored
+    cell = cellAfter(model, "\e[0;4:3;32m");
+    CHECK(cell.foreground == 2 && (cell.attributes & ATTR_UNDERLINE));
+}
+
+static void testPaletteQuantization(){
+    //exact cube colors and the ends of the gray ramp map to themselves
+    CHECK(nearestPaletteColor(0x00, 0x00, 0x00) == 16);
+    CHECK(nearestPaletteColor(0xFF, 0xFF, 0xFF) == 231);
+    CHECK(nearestPaletteColor(0x5F, 0x87, 0xAF) == 16 + 1 * 36 + 2 * 6 + 3);
+    CHECK(nearestPaletteColor(8, 8, 8) == 232);
+    CHECK(nearestPaletteColor(238, 238, 238) == 255);
+    //grays between the cube levels go to the ramp, colors to the nearest cube level on each channel
+    CHECK(nearestPaletteColor(128, 128, 128) == 244);
+    CHECK(nearestPaletteColor(0x30, 0x72, 0x74) == 16 + 1 * 36 + 1 * 6 + 2);
+    CHECK(nearestPaletteColor(250, 10, 10) == 196);
+
+    //and back, every index from the cube and the ramp round trips
+    for(int index = 16; index < 256; index++){
+        uint32_t rgb = paletteColor(index, DEFAULT_THEME);
+        CHECK(nearestPaletteColor(rgb >> 16, (rgb >> 8) & 0xFF, rgb & 0xFF) == index);
+    }
+    CHECK(paletteColor(3, DEFAULT_THEME) == 0xCDCD00);
+    CHECK(paletteColor(244, DEFAULT_THEME) == 0x808080);
+}
+
+static void testSynchronizedOutput(){
+    TerminalModel model;
+    model.resize(10, 2);
+    CHECK(!model.isSynchronized());
+
+    //output between BSU and ESU still reaches the grid, only showing it is up to the renderer
+    output(model, "\e[?2026hab");
+    CHECK(model.isSynchronized());
+    CHECK(screenText(model, 0) == "ab");
+    output(model, "\e[?2026l");
+    CHECK(!model.isSynchronized());
+
+    //set along with other modes, and split across reads
+    output(model, "\e[?2004;20");
+    output(model, "26h");
+    CHECK(model.isSynchronized() && model.isBracketedPaste());
+
+    //the renderer ends an update that took too long, a late ESU is then harmless
+    model.endSynchronizedUpdate();
+    CHECK(!model.isSynchronized());
+    output(model, "\e[?2026l");
+    CHECK(!model.isSynchronized());
+}
+
+static const uint64_t NS_PER_MS = 1000000;
+
+static void testSynchronizedTimeout(){
+    TerminalModel model;
+    model.resize(10, 2);
+
+    //the frame is held until the timeout, then the update is ended by force
+    model.setSynchronizedTimeout(150);
+    output(model, "\e[?2026h");
+    CHECK(model.holdingFrame(1000 * NS_PER_MS));
+    CHECK(model.getSynchronizedDeadlineNS() == 1150 * NS_PER_MS);
+    CHECK(model.holdingFrame(1149 * NS_PER_MS));
+    CHECK(!model.holdingFrame(1150 * NS_PER_MS));
+    CHECK(!model.isSynchronized() && model.getSynchronizedDeadlineNS() == 0);
+
+    //0 would never hold a frame, it's raised to the minimum
+    model.setSynchronizedTimeout(0);
+    output(model, "\e[?2026h");
+    CHECK(model.holdingFrame(2000 * NS_PER_MS));
+    CHECK(model.getSynchronizedDeadlineNS() == (2000 + TerminalModel::MIN_SYNC_TIMEOUT_MS) * NS_PER_MS);
+    CHECK(!model.holdingFrame((2000 + TerminalModel::MIN_SYNC_TIMEOUT_MS) * NS_PER_MS));
+
+    //a negative value as well, instead of wrapping to a huge unsigned timeout
+    model.setSynchronizedTimeout(-5);
+    output(model, "\e[?2026h");
+    CHECK(model.holdingFrame(3000 * NS_PER_MS));
+    CHECK(model.getSynchronizedDeadlineNS() == (3000 + TerminalModel::MIN_SYNC_TIMEOUT_MS) * NS_PER_MS);
+    model.endSynchronizedUpdate();
+    CHECK(!model.holdingFrame(3000 * NS_PER_MS));
+
+    //a timeout past the maximum would look like a hang, it's lowered to the maximum
+    model.setSynchronizedTimeout(60000);
+    output(model, "\e[?2026h");
+    CHECK(model.holdingFrame(4000 * NS_PER_MS));
+    CHECK(model.getSynchronizedDeadlineNS() == (4000 + TerminalModel::MAX_SYNC_TIMEOUT_MS) * NS_PER_MS);
+    CHECK(!model.holdingFrame((4000 + TerminalModel::MAX_SYNC_TIMEOUT_MS) * NS_PER_MS));
+    CHECK(!model.isSynchronized());
+}
+
+//the replies a sequence produced, cleared afterwards like Terminal does once it has queued them
+static std::string repliesTo(TerminalModel& model, const std::string& bytes){
+    output(model, bytes);
+    std::string replies = model.getReplies();
+    model.clearReplies();
+    return replies;
+}
+
+static void testModeReports(){
+    TerminalModel model;
+    model.resize(10, 2);
+
+    //known private modes report 1 when set and 2 when reset
+    CHECK(repliesTo(model, "\e[?2004$p") == "\e[?2004;2$y");
+    CHECK(repliesTo(model, "\e[?2004h\e[?2004$p") == "\e[?2004;1$y");
+    CHECK(repliesTo(model, "\e[?2026$p") == "\e[?2026;2$y");
+    CHECK(repliesTo(model, "\e[?2026h\e[?2026$p\e[?2026l") == "\e[?2026;1$y");
+    CHECK(repliesTo(model, "\e[?1049$p") == "\e[?1049;2$y");
+    CHECK(repliesTo(model, "\e[?1049h\e[?1049$p\e[?47$p\e[?1049l") == "\e[?1049;1$y\e[?47;1$y");
+
+    //unknown modes, private or not, report 0
+    CHECK(repliesTo(model, "\e[?9999$p") == "\e[?9999;0$y");
+    CHECK(repliesTo(model, "\e[4$p") == "\e[4;0$y");
+    CHECK(repliesTo(model, "\e[$p") == "\e[0;0$y");
+
+    //replies pile up until they are taken, in the order asked
+    output(model, "\e[?2004$p");
+    output(model, "\e[?2004l\e[?2004$p");
+    CHECK(repliesTo(model, "") == "\e[?2004;1$y\e[?2004;2$y");
+    CHECK(model.getReplies().empty());
+
+    //without the $ intermediate it is not a query
+    CHECK(repliesTo(model, "\e[?2004p") == "");
+}
+
+static void testResizeRewrap(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 4);
+    output(model, "0123456789abcdefghij\r\nXY");
+
+    CHECK(allLines(model) == std::vector<std::string>({"0123456789", "abcdefghij", "XY", ""}));
+    CHECK(model.getGrid().isWrapped(0));
+
+    model.resize(20, 4);
+    CHECK(allLines(model) == std::vector<std::string>({"0123456789abcdefghij", "XY", "", ""}));
+    CHECK(model.getCursorColumn() == 2 && model.getCursorRow() == 1);
+
+    //one more row than the screen holds, the first goes into the history
+    model.resize(5, 4);
+    CHECK(allLines(model) == std::vector<std::string>({"01234", "56789", "abcde", "fghij", "XY"}));
+    CHECK(model.getGrid().getHistorySize() == 1);
+    CHECK(model.getCursorColumn() == 2 && model.getCursorRow() == 3);
+
+    model.resize(10, 4);
+    CHECK(allLines(model) == std::vector<std::string>({"0123456789", "abcdefghij", "XY", ""}));
+    CHECK(model.getGrid().isWrapped(0) && !model.getGrid().isWrapped(1));
+    CHECK(model.getCursorColumn() == 2 && model.getCursorRow() == 2);
+
+    //text written after a resize goes where the cursor was moved to
+    output(model, "Z");
+    CHECK(screenText(model, 2) == "XYZ");
+}
+
+static void testFrozenHistory(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 4);
+    for(int i = 0; i < 30; i++)
+        output(model, "line" + std::to_string(100 + i) + "\r\n");
+
+    //the history stays in the frozen segment until scrolling back asks for it
+    model.resize(12, 4);
+    CHECK(screenText(model, 2) == "line129");
+
+    model.scrollView(5);
+    CHECK(model.getViewOffset() == 5);
+    CHECK(model.getGrid().getHistorySize() >= 5);
+    CHECK(lineText(model.getGrid(), model.getGrid().getHistorySize() - 5) == "line122");
+
+    model.scrollView(1 << 20);
+    CHECK(model.getViewOffset() == 27);
+    Grid& grid = model.getGrid();
+    CHECK(lineText(grid, 0) == "line100");
+    CHECK(lineText(grid, 26) == "line126");
+
+    //a second resize before the first segment has been read freezes it behind a newer one
+    model.scrollViewToBottom();
+    model.resize(4, 4);
+    model.resize(10, 4);
+    //no line is lost or repeated, whatever is below the last one is blank
+    std::vector<std::string> lines = allLines(model);
+    CHECK(lines.size() == static_cast<size_t>(model.getGrid().getHistorySize() + 4));
+    CHECK(lines.size() >= 31);
+    for(int i = 0; i < static_cast<int>(lines.size()); i++)
+        CHECK(lines[i] == (i < 30 ? "line" + std::to_string(100 + i) : ""));
+
+    //narrow enough that every line wraps once, the history is rewrapped as it's pulled in
+    model.resize(4, 4);
+    lines = allLines(model);
+    CHECK(lines.size() == 61);
+    CHECK(lines.size() > 3 && lines[0] == "line" && lines[1] == "100" && lines[2] == "line" && lines[3] == "101");
+}
+
+static void testScrollbackLimit(){
+    TerminalModel model;
+    model.setScrollbackLines(10);
+    model.resize(10, 4);
+    for(int i = 0; i < 30; i++)
+        output(model, "line" + std::to_string(100 + i) + "\r\n");
+    CHECK(model.getGrid().getHistorySize() == 10);
+
+    //the limit holds over the lines kept in frozen segments and the new ring together
+    model.resize(12, 4);
+    for(int i = 30; i < 35; i++)
+        output(model, "line" + std::to_string(100 + i) + "\r\n");
+    model.resize(8, 4);
+
+    std::vector<std::string> lines = allLines(model);
+    CHECK(model.getGrid().getHistorySize() <= 10);
+    CHECK(lines.size() == static_cast<size_t>(model.getGrid().getHistorySize() + 4));
+    //what is kept is the newest lines, in order
+    CHECK(lines.size() >= 2 && lines[lines.size() - 2] == "line134");
+    for(size_t i = 1; i + 1 < lines.size(); i++)
+        CHECK(lines[i] == "line" + std::to_string(std::stoi(lines[i - 1].substr(4)) + 1));
+}
+
+static void testScrollRegion(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 6);
+    output(model, "r0\r\nr1\r\nr2\r\nr3\r\nr4\r\nr5");
+
+    //DECSTBM homes the cursor, a line feed at the bottom margin scrolls only the region
+    output(model, "\e[2;4r");
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 0);
+    output(model, "\n\n\n\n");
+    CHECK(allLines(model) == std::vector<std::string>({"r0", "r2", "r3", "", "r4", "r5"}));
+    CHECK(model.getGrid().getHistorySize() == 0);
+    CHECK(model.getCursorRow() == 3);
+
+    //RI at the top margin scrolls it back down
+    output(model, "\eM\eM\eM");
+    CHECK(allLines(model) == std::vector<std::string>({"r0", "", "r2", "r3", "r4", "r5"}));
+
+    //below the region a line feed stops at the last row without scrolling
+    output(model, "\e[6;1H\n");
+    CHECK(model.getCursorRow() == 5);
+    CHECK(allLines(model) == std::vector<std::string>({"r0", "", "r2", "r3", "r4", "r5"}));
+
+    //resetting the region lets line feeds push the top row into the history again
+    output(model, "\e[r\n\n\n\n\n\n");
+    CHECK(model.getGrid().getHistorySize() == 1);
+    CHECK(lineText(model.getGrid(), 0) == "r0");
+}
+
+static void testScrollUpDown(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 5);
+    output(model, "s0\r\ns1\r\ns2\r\ns3\r\ns4");
+
+    //SU and SD move the region's text without moving the cursor, nothing goes into the history
+    output(model, "\e[2;4r\e[S");
+    CHECK(allLines(model) == std::vector<std::string>({"s0", "s2", "s3", "", "s4"}));
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 0);
+    output(model, "\e[2T");
+    CHECK(allLines(model) == std::vector<std::string>({"s0", "", "", "s2", "s4"}));
+    //a count past the region's height clears it
+    output(model, "\e[9S");
+    CHECK(allLines(model) == std::vector<std::string>({"s0", "", "", "", "s4"}));
+    CHECK(model.getGrid().getHistorySize() == 0);
+
+    //a region with its top at or below its bottom is ignored, the old one stays
+    output(model, "\e[4;4r\n\n\nx\n");
+    CHECK(allLines(model) == std::vector<std::string>({"s0", "", "x", "", "s4"}));
+    CHECK(model.getCursorRow() == 3);
+
+    //NEL is a line feed that also returns to the first column
+    output(model, "\eE");
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 3);
+
+    //scrolling a region only rotates row indexes, it never touches the heap
+    const std::string scrolling = "\rline\n\e[2S\e[T";
+    uint64_t allocationsBefore = allocationCount.load();
+    for(int i = 0; i < 1000; i++)
+        output(model, scrolling);
+    CHECK(allocationCount.load() == allocationsBefore);
+}
+
+static void testRegionCutsWrappedLines(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 5);
+    //rows 0 and 1 hold one wrapped line, row 1 is the top of the region
+    output(model, "0123456789abc\r\nx\r\ny");
+    CHECK(model.getGrid().isWrapped(0));
+
+    output(model, "\e[2;4r\n\n\n\n");
+    CHECK(screenText(model, 1) == "x");
+    //the row that continued row 0 scrolled away, so row 0 must not join with what is now below it
+    CHECK(!model.getGrid().isWrapped(0));
+
+    model.resize(20, 5);
+    CHECK(allLines(model)[0] == "0123456789");
+}
+
+static void testInsertDeleteLines(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 6);
+    output(model, "a0\r\na1\r\na2\r\na3\r\na4\r\na5");
+
+    output(model, "\e[r\n\n\t\e[2L");
+    CHECK(allLines(model) == std::vector<std::string>({"a0", "a1", "", "", "a2", "a3"}));
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 2);
+
+    output(model, "\e[r\e[M");
+    CHECK(allLines(model) == std::vector<std::string>({"a1", "", "", "a2", "a3", ""}));
+
+    //inside a region only the rows from the cursor to the bottom margin move
+    output(model, "\e[4;5r\n\n\n\e[L");
+    CHECK(allLines(model) == std::vector<std::string>({"a1", "", "", "", "a2", ""}));
+
+    //outside the region IL and DL do nothing
+    output(model, "\e[4;5r\e[M");
+    CHECK(allLines(model) == std::vector<std::string>({"a1", "", "", "", "a2", ""}));
+    CHECK(model.getGrid().getHistorySize() == 0);
+}
+
+static void testAlternateScreen(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 4);
+    output(model, "one\r\ntwo\r\nmain");
+
+    output(model, "\e[?1049h");
+    CHECK(model.isAlternateScreen());
+    CHECK(model.getGrid().getHistorySize() == 0);
+    for(int row = 0; row < 4; row++)
+        CHECK(screenText(model, row) == "");
+
+    output(model, "\e[ralt\r\n\n\nbottom");
+    CHECK(screenText(model, 0) == "alt");
+
+    //leaving restores the primary screen and the cursor saved on entry
+    output(model, "\e[?1049l");
+    CHECK(!model.isAlternateScreen());
+    CHECK(screenText(model, 0) == "one" && screenText(model, 2) == "main");
+    CHECK(model.getCursorColumn() == 4 && model.getCursorRow() == 2);
+
+    //entering again starts from a cleared alternate screen
+    output(model, "\e[?1049h");
+    CHECK(screenText(model, 0) == "" && screenText(model, 3) == "");
+
+    //a resize on the alternate screen rewraps the primary one and moves its saved cursor along
+    model.resize(2, 4);
+    output(model, "\e[?1049l");
+    CHECK(allLines(model) == std::vector<std::string>({"on", "e", "tw", "o", "ma", "in", ""}));
+    //it was past the end of "main", at this width that is the start of the next row
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 3);
+    model.resize(10, 4);
+    CHECK(allLines(model) == std::vector<std::string>({"one", "two", "main", "", ""}));
+    CHECK(screenText(model, model.getCursorRow()) == "main" && model.getCursorColumn() == 4);
+
+    //both screens are allocated up front, switching back and forth never touches the heap
+    const std::string cycle = "\e[?1049hx\e[?1049l";
+    uint64_t allocationsBefore = allocationCount.load();
+    for(int i = 0; i < 1000; i++)
+        output(model, cycle);
+    CHECK(allocationCount.load() == allocationsBefore);
+}
+
+static void testAlternateScreenModes(){
+    TerminalModel model;
+    model.setScrollbackLines(100);
+    model.resize(10, 3);
+    output(model, "h0\r\nh1\r\nh2\r\nh3\r\nmain");
+    CHECK(model.getGrid().getHistorySize() == 2);
+
+    //47 switches without saving the cursor or clearing, the alternate screen keeps its text
+    output(model, "\e[?47h");
+    CHECK(model.isAlternateScreen() && model.getCursorColumn() == 4 && model.getCursorRow() == 2);
+    output(model, "\e[ralt");
+    output(model, "\e[?47l\e[?47h");
+    CHECK(screenText(model, 0) == "alt");
+
+    //lines scrolled off the alternate screen are gone, the primary history is left alone and can't be scrolled to
+    output(model, "\e[r\n\n\n\n\n");
+    CHECK(model.getGrid().getHistorySize() == 0);
+    model.scrollView(5);
+    CHECK(model.getViewOffset() == 0);
+
+    //1047 clears the alternate screen when leaving it
+    output(model, "\e[?47l\e[?1047h\e[rgone\e[?1047l\e[?1047h");
+    CHECK(screenText(model, 0) == "");
+    output(model, "\e[?1047l");
+    CHECK(!model.isAlternateScreen());
+    CHECK(model.getGrid().getHistorySize() == 2 && lineText(model.getGrid(), 0) == "h0");
+
+    //1048 saves and restores the cursor and the pen without switching
+    output(model, "\e[r\n\t\e[31m\e[?1048h\e[r\e[m\e[?1048l");
+    CHECK(!model.isAlternateScreen() && model.getCursorColumn() == 8 && model.getCursorRow() == 1);
+    output(model, "x");
+    CHECK(model.getGrid().getRow(1)[8].foreground == 1);
+
+    //entering 1049 twice doesn't overwrite the saved cursor, leaving twice doesn't restore it again
+    output(model, "\e[r\n\n\t\e[?1049h\e[r\n\e[?1049h\e[?1049l");
+    CHECK(model.getCursorColumn() == 8 && model.getCursorRow() == 2);
+    output(model, "\e[r\e[?1049l");
+    CHECK(model.getCursorColumn() == 0 && model.getCursorRow() == 0);
+}
+
+int main(){
+    testSplitSequences();
+    testCsiParameters();
+    testCursorMovement();
+    testEraseUsesPenBackground();
+    testEraseSplitsWideCharacters();
+    testInvalidUtf8();
+    testCombiningAndWideCharacters();
+    testSelectGraphicRendition();
+    testPaletteQuantization();
+    testSynchronizedOutput();
+    testSynchronizedTimeout();
+    testModeReports();
+    testResizeRewrap();
+    testFrozenHistory();
+    testScrollbackLimit();
+    testScrollRegion();
+    testScrollUpDown();
+    testRegionCutsWrappedLines();
+    testInsertDeleteLines();
+    testAlternateScreen();
+    testAlternateScreenModes();
+
+    if(failures > 0){
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    std::printf("all checks passed\n");
+    return 0;
+}